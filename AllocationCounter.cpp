@@ -0,0 +1,26 @@
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+	thread_local long long allocations = 0;
+}
+
+long long AllocationCounter::threadAllocations() { return allocations; }
+
+// Replacements of the global allocation functions; array and nothrow forms forward to these
+void* operator new(std::size_t size) {
+	++allocations;
+	if (void* p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,14 @@
+#ifndef RAYTRACER_ALLOCATIONCOUNTER_H
+#define RAYTRACER_ALLOCATIONCOUNTER_H
+
+/*
+ * Counts calls to the global operator new, per thread (AllocationCounter.cpp replaces it).
+ * Take the difference around a piece of code to see how many heap allocations it made.
+ */
+class AllocationCounter {
+	public:
+		static long long threadAllocations();
+};
+
+
+#endif //RAYTRACER_ALLOCATIONCOUNTER_H
@@ -0,0 +1,51 @@
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+	size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+	while (currentBlock < blocks.size()) {
+		Block& block = blocks[currentBlock];
+		uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+		size_t start = alignUp(base + offset, alignment) - base;
+		if (start + size <= block.size) {
+			offset = start + size;
+			return block.data.get() + start;
+		}
+		// Does not fit: move on to the next block kept from an earlier tile, if any
+		++currentBlock;
+		offset = 0;
+	}
+
+	// Out of blocks: grow (the only heap allocation, made while the arena warms up)
+	size_t newSize = std::max(blockSize, size + alignment);
+	blocks.push_back(Block{std::unique_ptr<char[]>(new char[newSize]), newSize});
+	currentBlock = blocks.size() - 1;
+	offset = 0;
+	return allocate(size, alignment);
+}
+
+void Arena::rewind(const Mark& mark) {
+	currentBlock = mark.block;
+	offset = mark.offset;
+}
+
+size_t Arena::capacity() const {
+	size_t total = 0;
+	for (const Block& block : blocks) {
+		total += block.size;
+	}
+	return total;
+}
+
+Arena& Arena::forThread() {
+	thread_local Arena arena;
+	return arena;
+}
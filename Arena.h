@@ -0,0 +1,70 @@
+#ifndef RAYTRACER_ARENA_H
+#define RAYTRACER_ARENA_H
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Monotonic bump allocator for data that only lives while a tile is rendered.
+ * allocate() moves a pointer forward; nothing is freed individually, the whole arena is
+ * rewound to a mark instead. Blocks are kept when rewinding, so once the first tiles have
+ * grown it to its working size a render allocates nothing from the heap.
+ * Destructors are never run: only put types in here whose destructors do nothing.
+ */
+class Arena {
+	public:
+		struct Mark {
+			size_t block;
+			size_t offset;
+		};
+
+		explicit Arena(size_t blockSize = 64 * 1024);
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+		template <typename T, typename... Args>
+		T* create(Args&&... args) {
+			return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		Mark mark() const { return Mark{currentBlock, offset}; }
+		void rewind(const Mark& mark);	// frees everything allocated since mark
+		size_t capacity() const;	// bytes held in blocks
+
+		static Arena& forThread();	// the calling thread's arena
+
+	private:
+		struct Block {
+			std::unique_ptr<char[]> data;
+			size_t size;
+		};
+
+		std::vector<Block> blocks;
+		size_t blockSize;
+		size_t currentBlock = 0;
+		size_t offset = 0;	// first free byte in blocks[currentBlock]
+};
+
+
+/*
+ * Rewinds an arena to where it was when the scope was entered, e.g. around one tile.
+ * Scopes nest: a thread that picks up another tile while waiting inside one only
+ * frees what the inner tile allocated.
+ */
+class ArenaScope {
+	private:
+		Arena& arena;
+		Arena::Mark start;
+
+	public:
+		explicit ArenaScope(Arena& arena) : arena(arena), start(arena.mark()) {}
+		~ArenaScope() { arena.rewind(start); }
+		ArenaScope(const ArenaScope&) = delete;
+		ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+
+#endif //RAYTRACER_ARENA_H
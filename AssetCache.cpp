@@ -0,0 +1,34 @@
+#include "AssetCache.h"
+
+std::shared_ptr<const Texture> AssetCache::getTexture(const std::string& path, ColorSpace colorSpace, TextureLayout layout) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string key = path + (colorSpace == ColorSpace::SRGB ? "#srgb" : "") + "#" + textureLayoutName(layout);
+	std::shared_ptr<const Texture>& texture = textures[key];
+	if (texture) {
+		++textureHits;
+	} else {
+		texture = std::make_shared<const Texture>(path, colorSpace, layout);
+		++textureLoads;
+	}
+	return texture;
+}
+
+bool AssetCache::findGeometry(const std::string& key, std::vector<std::shared_ptr<Shape>>& shapes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = geometry.find(key);
+	if (it == geometry.end()) return false;
+	shapes = it->second;
+	++geometryHits;
+	return true;
+}
+
+void AssetCache::storeGeometry(const std::string& key, const std::vector<std::shared_ptr<Shape>>& shapes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	geometry[key] = shapes;
+	++geometryBuilds;
+}
+
+int AssetCache::getTextureHits() const { std::lock_guard<std::mutex> lock(mutex); return textureHits; }
+int AssetCache::getTextureLoads() const { std::lock_guard<std::mutex> lock(mutex); return textureLoads; }
+int AssetCache::getGeometryHits() const { std::lock_guard<std::mutex> lock(mutex); return geometryHits; }
+int AssetCache::getGeometryBuilds() const { std::lock_guard<std::mutex> lock(mutex); return geometryBuilds; }
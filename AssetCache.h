@@ -0,0 +1,41 @@
+#ifndef RAYTRACER_ASSETCACHE_H
+#define RAYTRACER_ASSETCACHE_H
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Texture.h"
+#include "Shape.h"
+
+/*
+ * Textures and shape lists shared by every scene loaded through it (batch rendering).
+ * Textures are keyed by file path; shape lists by the JSON text of a scene's "shapes" array,
+ * so two scenes with identical geometry and materials reuse the same Shape objects.
+ */
+class AssetCache {
+	private:
+		mutable std::mutex mutex;
+		std::map<std::string, std::shared_ptr<const Texture>> textures;	// by path, color space and layout
+		std::map<std::string, std::vector<std::shared_ptr<Shape>>> geometry;
+		int textureHits = 0;
+		int textureLoads = 0;
+		int geometryHits = 0;
+		int geometryBuilds = 0;
+
+	public:
+		std::shared_ptr<const Texture> getTexture(const std::string& path, ColorSpace colorSpace = ColorSpace::Linear,
+												  TextureLayout layout = TextureLayout::Tiled);	// loads on first use
+
+		// Returns true and fills shapes when a scene with the same shapes was stored before
+		bool findGeometry(const std::string& key, std::vector<std::shared_ptr<Shape>>& shapes);
+		void storeGeometry(const std::string& key, const std::vector<std::shared_ptr<Shape>>& shapes);
+
+		int getTextureHits() const;
+		int getTextureLoads() const;
+		int getGeometryHits() const;
+		int getGeometryBuilds() const;
+};
+
+
+#endif //RAYTRACER_ASSETCACHE_H
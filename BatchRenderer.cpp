@@ -0,0 +1,60 @@
+#include "BatchRenderer.h"
+#include <fstream>
+#include <omp.h>
+#include <stdexcept>
+
+BatchRenderer::BatchRenderer(std::shared_ptr<TaskScheduler> scheduler, std::function<void(Raytracer&)> configure,
+							 std::function<void(Raytracer&)> prepare)
+		: scheduler(scheduler), configure(configure), prepare(prepare) {}
+
+void BatchRenderer::setEncoding(const OutputEncoding& _encoding) { encoding = _encoding; }
+
+std::vector<BatchJob> BatchRenderer::readManifest(const std::string& filename) {
+	std::ifstream file(filename);
+	if (!file) {
+		throw std::runtime_error("Could not open batch manifest: " + filename);
+	}
+
+	nlohmann::json j = nlohmann::json::parse(file);
+	std::vector<BatchJob> jobs;
+	for (const auto& jobData : j["jobs"]) {
+		jobs.push_back(BatchJob{jobData["scene"], jobData["output"]});
+	}
+	return jobs;
+}
+
+std::vector<BatchJobReport> BatchRenderer::run(const std::vector<BatchJob>& jobs) {
+	std::vector<BatchJobReport> reports;
+	for (const BatchJob& job : jobs) {
+		BatchJobReport report;
+		report.job = job;
+		try {
+			double start = omp_get_wtime();
+			Raytracer raytracer;
+			if (prepare) prepare(raytracer);
+			raytracer.loadScene(job.scenePath, &cache);
+			raytracer.setTaskScheduler(scheduler);
+			if (configure) configure(raytracer);
+			Image image = raytracer.createImage();	// after configure, so NUMA first-touch applies
+			double loaded = omp_get_wtime();
+
+			raytracer.render(image);
+			double rendered = omp_get_wtime();
+
+			if (!image.write(job.outputPath, encoding)) {
+				throw std::runtime_error("Could not write " + job.outputPath);
+			}
+			report.loadTime = loaded - start;
+			report.renderTime = rendered - loaded;
+			report.writeTime = omp_get_wtime() - rendered;
+			report.pixels = static_cast<long long>(image.getWidth()) * image.getHeight();
+			report.succeeded = true;
+		} catch (const std::exception& e) {
+			report.error = e.what();
+		}
+		reports.push_back(report);
+	}
+	return reports;
+}
+
+const AssetCache& BatchRenderer::getCache() const { return cache; }
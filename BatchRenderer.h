@@ -0,0 +1,54 @@
+#ifndef RAYTRACER_BATCHRENDERER_H
+#define RAYTRACER_BATCHRENDERER_H
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AssetCache.h"
+#include "ImageEncoder.h"
+#include "Raytracer.h"
+#include "TaskScheduler.h"
+
+struct BatchJob {
+	std::string scenePath;
+	std::string outputPath;
+};
+
+struct BatchJobReport {
+	BatchJob job;
+	bool succeeded = false;
+	std::string error;
+	double loadTime = 0.0;		// readJSON + configuration + framebuffer (s)
+	double renderTime = 0.0;	// s
+	double writeTime = 0.0;		// s
+	long long pixels = 0;
+};
+
+/*
+ * Renders many scenes in one process. Every job shares the same thread pool
+ * (the OpenMP team, or the given work-stealing scheduler) and one AssetCache.
+ */
+class BatchRenderer {
+	private:
+		std::shared_ptr<TaskScheduler> scheduler;
+		std::function<void(Raytracer&)> configure;	// applied to every job after its scene is loaded
+		std::function<void(Raytracer&)> prepare;	// applied before, for settings that shape loading (texture layout, JSON streaming)
+		OutputEncoding encoding;	// of every job's output image
+		AssetCache cache;
+
+	public:
+		BatchRenderer(std::shared_ptr<TaskScheduler> scheduler, std::function<void(Raytracer&)> configure = nullptr,
+					  std::function<void(Raytracer&)> prepare = nullptr);
+
+		// Manifest: {"jobs": [{"scene": "a.json", "output": "a.ppm"}, ...]}
+		static std::vector<BatchJob> readManifest(const std::string& filename);
+
+		void setEncoding(const OutputEncoding& _encoding);
+
+		// Runs the jobs in order; a failing job is reported and skipped
+		std::vector<BatchJobReport> run(const std::vector<BatchJob>& jobs);
+		const AssetCache& getCache() const;
+};
+
+
+#endif //RAYTRACER_BATCHRENDERER_H
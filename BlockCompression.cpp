@@ -0,0 +1,158 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	struct Endpoints {
+		float color[2][3];
+	};
+
+	uint16_t toRGB565(const float* color) {
+		auto quantize = [](float value, int max) {
+			return static_cast<unsigned>(std::lrint(std::min(std::max(value, 0.0f), 255.0f) * max / 255.0f));
+		};
+		return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+	}
+
+	// The block's four colors exactly as decodeTexel reconstructs them (color0 > color1)
+	void palette(uint16_t color0, uint16_t color1, int colors[4][3]) {
+		uint8_t block[8] = {static_cast<uint8_t>(color0), static_cast<uint8_t>(color0 >> 8),
+							static_cast<uint8_t>(color1), static_cast<uint8_t>(color1 >> 8),
+							0x00, 0x55, 0xaa, 0xff};	// row i is index i for every texel
+		for (int index = 0; index < 4; ++index) {
+			uint8_t rgb[3];
+			BC1::decodeTexel(block, 0, index, rgb);
+			for (int channel = 0; channel < 3; ++channel) colors[index][channel] = rgb[channel];
+		}
+	}
+
+	// Nearest palette color of every texel; returns the squared error of the block
+	int chooseIndices(const uint8_t* rgba, const int colors[4][3], uint8_t* indices) {
+		int error = 0;
+		for (int texel = 0; texel < 16; ++texel) {
+			int best = 0, bestError = 1 << 30;
+			for (int index = 0; index < 4; ++index) {
+				int distance = 0;
+				for (int channel = 0; channel < 3; ++channel) {
+					int difference = rgba[texel * 4 + channel] - colors[index][channel];
+					distance += difference * difference;
+				}
+				if (distance < bestError) {
+					best = index;
+					bestError = distance;
+				}
+			}
+			indices[texel] = static_cast<uint8_t>(best);
+			error += bestError;
+		}
+		return error;
+	}
+
+	// Endpoints that fit the texels best in the least-squares sense for fixed indices; false if degenerate
+	bool refit(const uint8_t* rgba, const uint8_t* indices, Endpoints& endpoints) {
+		const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};	// share of color0 per index
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[3] = {}, bx[3] = {};
+		for (int texel = 0; texel < 16; ++texel) {
+			float a = weights[indices[texel]], b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int channel = 0; channel < 3; ++channel) {
+				ax[channel] += a * rgba[texel * 4 + channel];
+				bx[channel] += b * rgba[texel * 4 + channel];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f) return false;
+		for (int channel = 0; channel < 3; ++channel) {
+			endpoints.color[0][channel] = (ax[channel] * bb - bx[channel] * ab) / determinant;
+			endpoints.color[1][channel] = (bx[channel] * aa - ax[channel] * ab) / determinant;
+		}
+		return true;
+	}
+
+	// Packs endpoints and indices, ordered so the block decodes in four-color mode; returns the error
+	int pack(const uint8_t* rgba, const Endpoints& endpoints, uint8_t* block) {
+		uint16_t color0 = toRGB565(endpoints.color[0]);
+		uint16_t color1 = toRGB565(endpoints.color[1]);
+		if (color0 < color1) std::swap(color0, color1);
+
+		int colors[4][3];
+		palette(color0, color1, colors);
+		uint8_t indices[16] = {};
+		int error;
+		if (color0 != color1) {
+			error = chooseIndices(rgba, colors, indices);
+		} else {
+			// One color: every index 0 (equal endpoints decode in three-color mode, where index 3 is black)
+			const int single[4][3] = {{colors[0][0], colors[0][1], colors[0][2]}, {colors[0][0], colors[0][1], colors[0][2]},
+									  {colors[0][0], colors[0][1], colors[0][2]}, {colors[0][0], colors[0][1], colors[0][2]}};
+			error = chooseIndices(rgba, single, indices);
+		}
+
+		block[0] = static_cast<uint8_t>(color0);
+		block[1] = static_cast<uint8_t>(color0 >> 8);
+		block[2] = static_cast<uint8_t>(color1);
+		block[3] = static_cast<uint8_t>(color1 >> 8);
+		for (int y = 0; y < 4; ++y) {
+			block[4 + y] = static_cast<uint8_t>(indices[y * 4] | (indices[y * 4 + 1] << 2) |
+												(indices[y * 4 + 2] << 4) | (indices[y * 4 + 3] << 6));
+		}
+		return error;
+	}
+}
+
+void BC1::encodeBlock(const uint8_t* rgba, uint8_t* block) {
+	// Principal axis of the block's colors (power iteration on the covariance)
+	float mean[3] = {};
+	for (int texel = 0; texel < 16; ++texel) {
+		for (int channel = 0; channel < 3; ++channel) mean[channel] += rgba[texel * 4 + channel] / 16.0f;
+	}
+	float covariance[3][3] = {};
+	for (int texel = 0; texel < 16; ++texel) {
+		float d[3];
+		for (int channel = 0; channel < 3; ++channel) d[channel] = rgba[texel * 4 + channel] - mean[channel];
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j) covariance[i][j] += d[i] * d[j];
+		}
+	}
+	float axis[3] = {1.0f, 1.0f, 1.0f};
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[3];
+		for (int i = 0; i < 3; ++i) {
+			next[i] = covariance[i][0] * axis[0] + covariance[i][1] * axis[1] + covariance[i][2] * axis[2];
+		}
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (length < 1e-6f) break;	// flat block: any axis will do
+		for (int i = 0; i < 3; ++i) axis[i] = next[i] / length;
+	}
+
+	// Endpoints at the extremes of the texels along the axis
+	float lowest = 1e30f, highest = -1e30f;
+	for (int texel = 0; texel < 16; ++texel) {
+		float projection = 0.0f;
+		for (int channel = 0; channel < 3; ++channel) projection += (rgba[texel * 4 + channel] - mean[channel]) * axis[channel];
+		lowest = std::min(lowest, projection);
+		highest = std::max(highest, projection);
+	}
+	Endpoints endpoints;
+	for (int channel = 0; channel < 3; ++channel) {
+		endpoints.color[0][channel] = mean[channel] + axis[channel] * highest;
+		endpoints.color[1][channel] = mean[channel] + axis[channel] * lowest;
+	}
+	int error = pack(rgba, endpoints, block);
+
+	// One least-squares refinement of the endpoints for the indices just chosen, kept if it helps
+	uint8_t indices[16];
+	uint16_t color0 = block[0] | (block[1] << 8), color1 = block[2] | (block[3] << 8);
+	if (error > 0 && color0 != color1) {
+		for (int texel = 0; texel < 16; ++texel) indices[texel] = (block[4 + texel / 4] >> (2 * (texel % 4))) & 3;
+		Endpoints refined;
+		uint8_t candidate[BC1::blockBytes];
+		// indices refer to (color0, color1) as packed, which is the order the weights assume
+		if (refit(rgba, indices, refined) && pack(rgba, refined, candidate) < error) {
+			std::copy(candidate, candidate + BC1::blockBytes, block);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef RAYTRACER_BLOCKCOMPRESSION_H
+#define RAYTRACER_BLOCKCOMPRESSION_H
+#include <cstdint>
+
+/*
+ * BC1 (DXT1) block compression: a 4x4 block of RGB texels in 8 bytes, two RGB565 endpoint
+ * colors and a 2-bit index per texel into the four colors on the line between them.
+ * That is an eighth of RGBA8 storage; the loss is mostly visible on sharp edges between
+ * more than two colors, which albedo maps have little of.
+ */
+namespace BC1 {
+	const int blockBytes = 8;
+
+	// rgba: the 16 texels of the block, row by row, 4 bytes each (alpha is ignored)
+	void encodeBlock(const uint8_t* rgba, uint8_t* block);
+
+	// Texel (x, y) of a block (x, y in [0, 4)) to 8-bit RGB. Inline: one of these per compressed texel fetch
+	inline void decodeTexel(const uint8_t* block, int x, int y, uint8_t* rgb) {
+		unsigned color0 = block[0] | (block[1] << 8);
+		unsigned color1 = block[2] | (block[3] << 8);
+		unsigned index = (block[4 + y] >> (2 * x)) & 3;
+		unsigned endpoints[2][3] = {
+				{((color0 >> 11) * 527 + 23) >> 6, (((color0 >> 5) & 63) * 259 + 33) >> 6, ((color0 & 31) * 527 + 23) >> 6},
+				{((color1 >> 11) * 527 + 23) >> 6, (((color1 >> 5) & 63) * 259 + 33) >> 6, ((color1 & 31) * 527 + 23) >> 6}
+		};
+		for (int channel = 0; channel < 3; ++channel) {
+			unsigned a = endpoints[0][channel], b = endpoints[1][channel];
+			unsigned value;
+			if (index < 2) value = index == 0 ? a : b;
+			else if (color0 > color1) value = index == 2 ? (2 * a + b) / 3 : (a + 2 * b) / 3;
+			else value = index == 2 ? (a + b) / 2 : 0;	// three-color mode: index 3 is black
+			rgb[channel] = static_cast<uint8_t>(value);
+		}
+	}
+}
+
+
+#endif //RAYTRACER_BLOCKCOMPRESSION_H
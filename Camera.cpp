@@ -45,8 +45,9 @@ Ray PinholeCamera::generateRay(float u, float v) const {
 	Vector3 rayDirection = (lowerLeftCorner + horizontal * u + vertical * v) - position;
 	rayDirection = rayDirection.normalize();
 
-	// Return the ray starting from the camera position
-	return Ray(position, rayDirection);
+	// Return the ray starting from the camera position; its cone opens by one pixel's angle
+	float pixelAngle = viewportHeight / static_cast<float>(height);
+	return Ray(position, rayDirection, 0.0f, pixelAngle);
 }
 
 
@@ -81,8 +82,8 @@ Ray OrthographicCamera::generateRay(float u, float v) const {
 	// The ray direction is fixed for orthographic projection
 	Vector3 rayDirection = forwardVector;  // Typically normalized during basis vector computation
 
-	// Return the ray
-	return Ray(rayOrigin, rayDirection);
+	// Return the ray: parallel rays, each one pixel (one world unit) wide
+	return Ray(rayOrigin, rayDirection, 1.0f, 0.0f);
 }
 
 
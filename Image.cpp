@@ -1,12 +1,176 @@
 #include "Image.h"
 #include <fstream>
 #include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <cctype>
+#include "PNGWriter.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define RAYTRACER_HAS_MMAP 1
+#endif
+
+/* A P6 file mapped shared and writable, plus which of its rows are done */
+struct Image::MappedStorage {
+	std::string filename;
+	uint8_t* mapping = nullptr;
+	size_t mappingSize = 0;
+	size_t headerSize = 0;	// pixel data starts here
+	size_t rowBytes = 0;
+
+	std::mutex mutex;
+	std::vector<bool> finishedRows;
+	size_t finishedPrefix = 0;	// rows [0, finishedPrefix) are all finished
+	size_t evictedBytes = 0;	// [0, evictedBytes) of the mapping is on disk and dropped
+
+	~MappedStorage() {
+#ifdef RAYTRACER_HAS_MMAP
+		if (mapping) {
+			msync(mapping, mappingSize, MS_SYNC);
+			munmap(mapping, mappingSize);
+		}
+#endif
+	}
+};
 //TODO: maybe replace r,g, b with a single color struct = Vector3 (replace in .h too)
 
 Image::Image() : width(0), height(0) {}
 
-Image::Image(int w, int h) : width(w), height(h) {
-	pixels.resize(width * height);
+Image::Image(int w, int h) : Image(w, h, true) {}
+
+Image::Image(int w, int h, bool initialize, PixelFormat format)
+		: width(w), height(h), format(format), pixelBytes(bytesPerPixel(format)) {
+	if (initialize) {
+		pixels.resize(static_cast<size_t>(width) * height * pixelBytes, 0);	// all zero bits is black in every format
+	} else {
+		pixels.resize(static_cast<size_t>(width) * height * pixelBytes);
+	}
+}
+
+Image Image::mapPPM(const std::string& filename, int w, int h) {
+#ifdef RAYTRACER_HAS_MMAP
+	Image image;
+	image.width = w;
+	image.height = h;
+	image.format = PixelFormat::RGB8;
+	image.pixelBytes = bytesPerPixel(PixelFormat::RGB8);
+
+	auto storage = std::make_shared<MappedStorage>();
+	std::string header = "P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+	storage->filename = filename;
+	storage->headerSize = header.size();
+	storage->rowBytes = static_cast<size_t>(w) * image.pixelBytes;
+	storage->mappingSize = storage->headerSize + storage->rowBytes * static_cast<size_t>(h);
+	storage->finishedRows.assign(h, false);
+
+	int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		throw std::runtime_error("Could not create framebuffer file: " + filename);
+	}
+	// Sparse file of the final size: blocks are only allocated as rows are written
+	if (ftruncate(fd, static_cast<off_t>(storage->mappingSize)) != 0 ||
+		pwrite(fd, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size())) {
+		close(fd);
+		throw std::runtime_error("Could not size framebuffer file: " + filename);
+	}
+	void* mapping = mmap(nullptr, storage->mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);	// the mapping keeps the file open
+	if (mapping == MAP_FAILED) {
+		throw std::runtime_error("Could not map framebuffer file: " + filename);
+	}
+	storage->mapping = static_cast<uint8_t*>(mapping);
+	image.mapped = storage;
+	return image;
+#else
+	(void)w;
+	(void)h;
+	throw std::runtime_error("Memory-mapped framebuffers are not supported on this platform: " + filename);
+#endif
+}
+
+bool Image::isMapped() const { return mapped != nullptr; }
+
+void Image::finishRows(int y0, int y1) {
+#ifdef RAYTRACER_HAS_MMAP
+	if (!mapped) return;
+	MappedStorage& storage = *mapped;
+	std::lock_guard<std::mutex> lock(storage.mutex);
+	for (int y = std::max(y0, 0); y < std::min(y1, height); ++y) {
+		storage.finishedRows[y] = true;
+	}
+	while (storage.finishedPrefix < storage.finishedRows.size() && storage.finishedRows[storage.finishedPrefix]) {
+		++storage.finishedPrefix;
+	}
+
+	// Only whole pages can be dropped: stop at the last page boundary inside the finished prefix
+	size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t finishedBytes = storage.headerSize + storage.finishedPrefix * storage.rowBytes;
+	if (storage.finishedPrefix == storage.finishedRows.size()) {
+		finishedBytes = (storage.mappingSize + pageSize - 1) / pageSize * pageSize;
+	}
+	size_t evictEnd = finishedBytes / pageSize * pageSize;
+	if (evictEnd > storage.evictedBytes) {
+		uint8_t* start = storage.mapping + storage.evictedBytes;
+		size_t length = std::min(evictEnd, storage.mappingSize) - storage.evictedBytes;
+		msync(start, length, MS_SYNC);	// write through...
+		madvise(start, length, MADV_DONTNEED);	// ...then drop the clean pages
+		storage.evictedBytes = evictEnd;
+	}
+#else
+	(void)y0;
+	(void)y1;
+#endif
+}
+
+uint8_t* Image::pixelData() {
+	return mapped ? mapped->mapping + mapped->headerSize : pixels.data();
+}
+
+const uint8_t* Image::pixelData() const {
+	return mapped ? mapped->mapping + mapped->headerSize : pixels.data();
+}
+
+void Image::storePixel(size_t index, const Color& color) {
+	uint8_t* pixel = pixelData() + index * pixelBytes;
+	switch (format) {
+		case PixelFormat::RGB16F:
+			encodeHalf(color, pixel);
+			break;
+		case PixelFormat::RGBE:
+			encodeRGBE(color, pixel);
+			break;
+		case PixelFormat::RGB8:
+			pixel[0] = static_cast<uint8_t>(std::min(std::max(color.getR(), 0.0f), 1.0f) * 255);
+			pixel[1] = static_cast<uint8_t>(std::min(std::max(color.getG(), 0.0f), 1.0f) * 255);
+			pixel[2] = static_cast<uint8_t>(std::min(std::max(color.getB(), 0.0f), 1.0f) * 255);
+			break;
+		default: {
+			float channels[3] = {color.getR(), color.getG(), color.getB()};
+			std::memcpy(pixel, channels, sizeof(channels));
+		}
+	}
+}
+
+Color Image::fetchPixel(size_t index) const {
+	const uint8_t* pixel = pixelData() + index * pixelBytes;
+	switch (format) {
+		case PixelFormat::RGB16F:
+			return decodeHalf(pixel);
+		case PixelFormat::RGBE:
+			return decodeRGBE(pixel);
+		case PixelFormat::RGB8:
+			return Color(pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f);
+		default: {
+			float channels[3];
+			std::memcpy(channels, pixel, sizeof(channels));
+			return Color(channels[0], channels[1], channels[2]);
+		}
+	}
 }
 
 /*void Image::setPixelColor(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
@@ -27,8 +191,7 @@ void Image::setPixelColor(int x, int y, Color color) {
 		throw std::out_of_range("Pixel coordinates out of bounds");
 	}
 
-	int index = (y * width + x);
-	pixels[index] = color;
+	storePixel(static_cast<size_t>(y) * width + x, color);
 }
 
 /*void Image::setPixelColorFloat(int x, int y, float r, float g, float b) {
@@ -38,7 +201,39 @@ void Image::setPixelColor(int x, int y, Color color) {
 				  static_cast<uint8_t>(b * 255));
 }*/
 
-bool Image::writePPM(const std::string& filename) const {
+void Image::decodeRow(int y, float* rgb) const {
+	size_t first = static_cast<size_t>(y) * width;
+	if (format == PixelFormat::RGB32F) {
+		std::memcpy(rgb, pixelData() + first * pixelBytes, static_cast<size_t>(width) * pixelBytes);
+		return;
+	}
+	for (int x = 0; x < width; ++x) {
+		Color color = fetchPixel(first + x);
+		rgb[3 * x] = color.getR();
+		rgb[3 * x + 1] = color.getG();
+		rgb[3 * x + 2] = color.getB();
+	}
+}
+
+void Image::encodeRow(int y, const float* rgb) {
+	size_t first = static_cast<size_t>(y) * width;
+	if (format == PixelFormat::RGB32F) {
+		std::memcpy(pixelData() + first * pixelBytes, rgb, static_cast<size_t>(width) * pixelBytes);
+		return;
+	}
+	for (int x = 0; x < width; ++x) {
+		storePixel(first + x, Color(rgb[3 * x], rgb[3 * x + 1], rgb[3 * x + 2]));
+	}
+}
+
+bool Image::writePPM(const std::string& filename, const OutputEncoding& encoding) const {
+#ifdef RAYTRACER_HAS_MMAP
+	if (mapped && filename == mapped->filename) {
+		// the file already is the image: just make sure it all reached the disk
+		return msync(mapped->mapping, mapped->mappingSize, MS_SYNC) == 0;
+	}
+#endif
+
 	std::ofstream file(filename, std::ios::binary);
 	if (!file) {
 		return false;
@@ -48,78 +243,170 @@ bool Image::writePPM(const std::string& filename) const {
 	file << width << " " << height << "\n";
 	file << "255\n";
 
-	// Write pixel data
-	for (const Color& color : pixels) {
-		file.put(static_cast<char>(color.getR() * 255));  // Red channel
-		file.put(static_cast<char>(color.getG() * 255));  // Green channel
-		file.put(static_cast<char>(color.getB() * 255));  // Blue channel
+	if (format == PixelFormat::RGB8) {
+		// already the bytes of a P6 file (converting back through float could round them down)
+		file.write(reinterpret_cast<const char*>(pixelData()), static_cast<std::streamsize>(getByteSize()));
+		return file.good();
+	}
+
+	// Write pixel data: convert a band of rows in parallel, then write it in one go
+	const int bandRows = 256;
+	size_t rowBytes = static_cast<size_t>(width) * 3;
+	RowEncoder encoder(encoding, width);
+	std::vector<uint8_t> band(rowBytes * std::min(bandRows, height));
+	for (int y0 = 0; y0 < height; y0 += bandRows) {
+		int y1 = std::min(y0 + bandRows, height);
+		encodeRows(encoder, y0, y1, band.data());
+		file.write(reinterpret_cast<const char*>(band.data()), static_cast<std::streamsize>((y1 - y0) * rowBytes));
 	}
-	//file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
 
 	return file.good();
 }
 
-int Image::getWidth() const { return width; }
-int Image::getHeight() const { return height; }
+bool Image::writePNG(const std::string& filename, const OutputEncoding& encoding) const {
+	if (format == PixelFormat::RGB8) {
+		return ::writePNG(filename, pixelData(), width, height);
+	}
+	std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+	encodeRows(RowEncoder(encoding, width), 0, height, rgb.data());
+	return ::writePNG(filename, rgb.data(), width, height);
+}
 
-#include <sstream>
-#include <iostream>	//DEBUG
+namespace {
+	bool hostIsLittleEndian() {
+		uint16_t probe = 1;
+		uint8_t first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
 
-Image::Image(const std::string& filename) {
-	if (!loadPPM(filename)) {
-		throw std::runtime_error("Failed to load PPM file: " + filename);
+	void swapFloatBytes(float* values, size_t count) {
+		uint8_t* bytes = reinterpret_cast<uint8_t*>(values);
+		for (size_t i = 0; i < count; ++i, bytes += 4) {
+			std::swap(bytes[0], bytes[3]);
+			std::swap(bytes[1], bytes[2]);
+		}
 	}
 }
 
-bool Image::loadPPM(const std::string& filename) {
-	std::cout << "Attempting to load texture: " << filename << std::endl;
-
-	if (!std::filesystem::exists(filename)) {
-		std::cerr << "File does not exist: " << filename << std::endl;
+bool Image::writePFM(const std::string& filename) const {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
 		return false;
-	} else {
-		std::cout << "File exists " << filename << std::endl;
 	}
 
+	// A negative scale marks little-endian data
+	file << "PF\n";
+	file << width << " " << height << "\n";
+	file << "-1.0\n";
+
+	bool swap = !hostIsLittleEndian();
+	std::vector<float> row(static_cast<size_t>(width) * 3);
+	for (int y = height - 1; y >= 0; --y) {
+		decodeRow(y, row.data());
+		if (swap) swapFloatBytes(row.data(), row.size());
+		file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+	}
+
+	return file.good();
+}
+
+bool Image::write(const std::string& filename, const OutputEncoding& encoding) const {
+	std::string extension = std::filesystem::path(filename).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	if (extension == ".png") {
+		return writePNG(filename, encoding);
+	}
+	if (extension == ".pfm") {
+		return writePFM(filename);
+	}
+	return writePPM(filename, encoding);
+}
+
+void Image::encodeRows(const RowEncoder& encoder, int y0, int y1, uint8_t* out) const {
+	size_t rowBytes = static_cast<size_t>(width) * 3;
+	#pragma omp parallel
+	{
+		std::vector<float> row(rowBytes);
+		#pragma omp for schedule(static)
+		for (int y = y0; y < y1; ++y) {
+			quantizeRow(encoder, y, row.data(), out + (y - y0) * rowBytes);
+		}
+	}
+}
+
+void Image::quantizeRow(const RowEncoder& encoder, int y, float* scratch, uint8_t* out) const {
+	size_t rowBytes = static_cast<size_t>(width) * 3;
+	if (format == PixelFormat::RGB8) {
+		// already the bytes (converting back through float could round them down)
+		std::memcpy(out, pixelData() + static_cast<size_t>(y) * rowBytes, rowBytes);
+		return;
+	}
+	decodeRow(y, scratch);
+	encoder.encodeRow(scratch, y, out, rowBytes);
+}
+
+int Image::getWidth() const { return width; }
+int Image::getHeight() const { return height; }
+PixelFormat Image::getFormat() const { return format; }
+size_t Image::getByteSize() const {
+	return mapped ? mapped->rowBytes * static_cast<size_t>(height) : pixels.size();
+}
+
+Color Image::getPixelColor(int x, int y) const {
+	if (x < 0 || x >= width || y < 0 || y >= height) {
+		throw std::out_of_range("Pixel coordinates out of bounds");
+	}
 
+	return fetchPixel(static_cast<size_t>(y) * width + x);
+}
+
+bool Image::loadPFM(const std::string& filename) {
 	std::ifstream file(filename, std::ios::binary);
 	if (!file) {
-		std::cout << "Failed to open file" << std::endl;
 		return false;
 	}
 
 	std::string header;
 	file >> header;
-	if (header != "P6") {
-		std::cout << "Header not P6" << std::endl;
+	int channels = header == "PF" ? 3 : header == "Pf" ? 1 : 0;
+	if (channels == 0) {
 		return false;
 	}
 
-	file >> width >> height;
-	int maxValue;
-	file >> maxValue;
+	int w, h;
+	float scale;
+	file >> w >> h >> scale;
 	file.ignore(1);  // Skip the single whitespace after the header
-
-	pixels.resize(width * height);
-
-	for (int i = 0; i < width * height; ++i) {
-		char r, g, b;
-		file.get(r).get(g).get(b);
-		pixels[i] = Color(
-				static_cast<uint8_t>(r) / 255.0f,
-				static_cast<uint8_t>(g) / 255.0f,
-				static_cast<uint8_t>(b) / 255.0f
-		);
+	if (!file || w <= 0 || h <= 0) {
+		return false;
 	}
 
-	return true;
-}
+	width = w;
+	height = h;
+	mapped = nullptr;
+	format = PixelFormat::RGB32F;
+	pixelBytes = bytesPerPixel(format);
+	pixels.resize(static_cast<size_t>(width) * height * pixelBytes);
 
-Color Image::getPixelColor(int x, int y) const {
-	if (x < 0 || x >= width || y < 0 || y >= height) {
-		throw std::out_of_range("Pixel coordinates out of bounds");
+	// The sign of the scale gives the byte order of the data; its magnitude is only a hint
+	bool swap = (scale < 0.0f) != hostIsLittleEndian();
+	std::vector<float> values(static_cast<size_t>(width) * channels);
+	std::vector<float> row(static_cast<size_t>(width) * 3);
+	for (int y = height - 1; y >= 0; --y) {
+		if (!file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)))) {
+			return false;
+		}
+		if (swap) swapFloatBytes(values.data(), values.size());
+		if (channels == 3) {
+			encodeRow(y, values.data());
+			continue;
+		}
+		for (int x = 0; x < width; ++x) {
+			row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = values[x];
+		}
+		encodeRow(y, row.data());
 	}
 
-	return pixels[y * width + x];
+	return true;
 }
-
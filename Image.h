@@ -4,18 +4,57 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <memory>
 #include "Color.h"
+#include "PixelFormat.h"
+#include "ImageEncoder.h"
+
+/* Allocator whose value-initialisation is a no-op, so resize() leaves fresh pages untouched */
+template <typename T>
+struct UninitializedAllocator : std::allocator<T> {
+	template <typename U> struct rebind { using other = UninitializedAllocator<U>; };
+	UninitializedAllocator() = default;
+	template <typename U> UninitializedAllocator(const UninitializedAllocator<U>&) {}
+
+	template <typename U> void construct(U*) {}
+	template <typename U, typename... Args> void construct(U* p, Args&&... args) {
+		::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+	}
+};
 
 class Image {
 	private:
-		std::vector<Color> pixels;	//Before: std::vector<uint8_t> pixels;
+		std::vector<uint8_t, UninitializedAllocator<uint8_t>> pixels;	// encoded in format, bytesPerPixel each
 		int width;	//same as camera?
 		int height;
+		PixelFormat format = PixelFormat::RGB32F;
+		int pixelBytes = 12;
+
+		struct MappedStorage;
+		std::shared_ptr<MappedStorage> mapped = nullptr;	// instead of pixels when backed by a file
+
+		uint8_t* pixelData();
+		const uint8_t* pixelData() const;
+		void storePixel(size_t index, const Color& color);
+		Color fetchPixel(size_t index) const;
+		void encodeRows(const RowEncoder& encoder, int y0, int y1, uint8_t* out) const;	// rows [y0, y1) to 8-bit RGB, in parallel
 
 	public:
 		Image();
 		Image(int w, int h);
-		Image(const std::string& filename);  // New constructor to load PPM file
+		// initialize = false leaves the pixels unwritten, so each page is first touched (and placed
+		// on the NUMA node of) the thread that renders it; every pixel must be set before reading
+		Image(int w, int h, bool initialize, PixelFormat format = PixelFormat::RGB32F);
+
+		// Framebuffer living in filename, a P6 PPM of the final size mapped into memory (RGB8).
+		// Pixels go straight into the page cache; finishRows() writes them to disk and drops
+		// them from memory, so images far larger than RAM render in a bounded footprint.
+		// Copies of a mapped image share the same file.
+		static Image mapPPM(const std::string& filename, int w, int h);
+		bool isMapped() const;
+		// Rows [y0, y1) will not change again. Once every row above a page is finished that page
+		// is written back and evicted (a no-op for images in memory). Safe from several threads.
+		void finishRows(int y0, int y1);
 
 		// Integer version (0-255)
 		/*void setPixelColor(int x, int y, uint8_t r, uint8_t g, uint8_t b);*/
@@ -25,12 +64,24 @@ class Image {
 		// Float version (0.0-1.0)
 		/*void setPixelColorFloat(int x, int y, float r, float g, float b);*/
 
-		bool writePPM(const std::string& filename) const;
+		// P6 file; encoding picks the transfer curve and dithering (RGB8 images are written as stored)
+		bool writePPM(const std::string& filename, const OutputEncoding& encoding = OutputEncoding()) const;
+		bool writePNG(const std::string& filename, const OutputEncoding& encoding = OutputEncoding()) const;
+		// Portable float map of the stored values, unclamped (little-endian, rows bottom to top)
+		bool writePFM(const std::string& filename) const;
+		// Picks the writer from the extension: .png, .pfm, anything else is written as PPM
+		bool write(const std::string& filename, const OutputEncoding& encoding = OutputEncoding()) const;
 		int getWidth() const;
 		int getHeight() const;
+		PixelFormat getFormat() const;
+		size_t getByteSize() const;	// memory (or file space) taken by the pixels
 
 		Color getPixelColor(int x, int y) const;  // Fetch color at (x, y)
-		bool loadPPM(const std::string& filename);  // Load texture from PPM file
+		void decodeRow(int y, float* rgb) const;	// row y as 3 * width floats
+		void encodeRow(int y, const float* rgb);	// the reverse of decodeRow
+		// Row y as 3 * width bytes through encoder (scratch holds 3 * width floats); RGB8 rows are copied as stored
+		void quantizeRow(const RowEncoder& encoder, int y, float* scratch, uint8_t* out) const;
+		bool loadPFM(const std::string& filename);  // Load an RGB ("PF") or grayscale ("Pf") float map as RGB32F
 };
 
 #endif // IMAGE_HPP
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+	const int curveSize = 65536;
+
+	const int bayer8[8][8] = {
+			{ 0, 32,  8, 40,  2, 34, 10, 42},
+			{48, 16, 56, 24, 50, 18, 58, 26},
+			{12, 44,  4, 36, 14, 46,  6, 38},
+			{60, 28, 52, 20, 62, 30, 54, 22},
+			{ 3, 35, 11, 43,  1, 33,  9, 41},
+			{51, 19, 59, 27, 49, 17, 57, 25},
+			{15, 47,  7, 39, 13, 45,  5, 37},
+			{63, 31, 55, 23, 61, 29, 53, 21}
+	};
+
+	float encodeValue(float value, const OutputEncoding& encoding) {
+		if (encoding.transfer == TransferFunction::SRGB) {
+			return value <= 0.0031308f ? 12.92f * value : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+		}
+		if (encoding.transfer == TransferFunction::Gamma) {
+			return std::pow(value, 1.0f / encoding.gamma);
+		}
+		return value;
+	}
+}
+
+TransferFunction parseTransferFunction(const std::string& name) {
+	if (name == "linear") return TransferFunction::Linear;
+	if (name == "gamma") return TransferFunction::Gamma;
+	if (name == "srgb") return TransferFunction::SRGB;
+	throw std::invalid_argument("Unknown transfer function: " + name);
+}
+
+
+RowEncoder::RowEncoder(const OutputEncoding& encoding, int width) : encoding(encoding) {
+	if (encoding.transfer != TransferFunction::Linear) {
+		curve.resize(curveSize);
+		for (int i = 0; i < curveSize; ++i) {
+			curve[i] = encodeValue(static_cast<float>(i) / (curveSize - 1), encoding) * 255.0f;
+		}
+	}
+	if (encoding.dither) {
+		ditherRows.assign(8, std::vector<float>(static_cast<size_t>(width) * 3));
+		for (int y = 0; y < 8; ++y) {
+			for (int x = 0; x < width; ++x) {
+				float threshold = (bayer8[y][x % 8] + 0.5f) / 64.0f;
+				for (int channel = 0; channel < 3; ++channel) {
+					ditherRows[y][static_cast<size_t>(x) * 3 + channel] = threshold;
+				}
+			}
+		}
+	}
+}
+
+void RowEncoder::encodeRow(const float* rgb, int y, uint8_t* out, size_t count) const {
+	const float* dither = encoding.dither ? ditherRows[y % 8].data() : nullptr;
+	const float* table = curve.empty() ? nullptr : curve.data();
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f), tableScale = _mm_set1_ps(curveSize - 1);
+	for (; i + 4 <= count; i += 4) {
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(rgb + i), zero), one);
+		__m128 scaled;
+		if (table) {
+			alignas(16) int index[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvtps_epi32(_mm_mul_ps(value, tableScale)));
+			scaled = _mm_set_ps(table[index[3]], table[index[2]], table[index[1]], table[index[0]]);
+		} else {
+			scaled = _mm_mul_ps(value, scale);
+		}
+		if (dither) scaled = _mm_add_ps(scaled, _mm_loadu_ps(dither + i));
+
+		__m128i bytes = _mm_cvttps_epi32(scaled);	// truncate, like the scalar cast
+		bytes = _mm_packs_epi32(bytes, bytes);
+		bytes = _mm_packus_epi16(bytes, bytes);
+		uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(bytes));
+		std::memcpy(out + i, &packed, 4);
+	}
+#elif defined(__aarch64__)
+	const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t value = vminq_f32(vmaxq_f32(vld1q_f32(rgb + i), zero), one);
+		float32x4_t scaled;
+		if (table) {
+			uint32_t index[4];
+			vst1q_u32(index, vcvtnq_u32_f32(vmulq_n_f32(value, curveSize - 1)));
+			float lanes[4] = {table[index[0]], table[index[1]], table[index[2]], table[index[3]]};
+			scaled = vld1q_f32(lanes);
+		} else {
+			scaled = vmulq_n_f32(value, 255.0f);
+		}
+		if (dither) scaled = vaddq_f32(scaled, vld1q_f32(dither + i));
+
+		uint16x4_t narrow = vqmovn_u32(vcvtq_u32_f32(scaled));
+		uint8_t bytes[8];
+		vst1_u8(bytes, vqmovn_u16(vcombine_u16(narrow, narrow)));
+		std::memcpy(out + i, bytes, 4);
+	}
+#endif
+
+	for (; i < count; ++i) {
+		float value = std::min(std::max(rgb[i], 0.0f), 1.0f);
+		float scaled = table ? table[static_cast<int>(std::lrint(value * (curveSize - 1)))] : value * 255.0f;
+		if (dither) scaled += dither[i];
+		out[i] = static_cast<uint8_t>(std::min(scaled, 255.0f));
+	}
+}
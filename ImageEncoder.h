@@ -0,0 +1,42 @@
+#ifndef RAYTRACER_IMAGEENCODER_H
+#define RAYTRACER_IMAGEENCODER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Curve applied to the [0, 1] framebuffer values before they are quantized to 8 bits */
+enum class TransferFunction {
+	Linear,	// value * 255, what writePPM always did
+	Gamma,	// value^(1/gamma)
+	SRGB	// the piecewise sRGB curve
+};
+
+TransferFunction parseTransferFunction(const std::string& name);	// "linear", "gamma" or "srgb"
+
+struct OutputEncoding {
+	TransferFunction transfer = TransferFunction::Linear;
+	float gamma = 2.2f;
+	bool dither = false;	// ordered (8x8 Bayer) dithering instead of truncation: no banding in smooth gradients
+};
+
+
+/*
+ * Converts rows of float RGB to 8-bit RGB, four channels per SIMD instruction (SSE2 / NEON).
+ * Without dithering values are truncated exactly like the old per-channel writer;
+ * curves other than linear go through a 64K-entry table built once per encoder.
+ */
+class RowEncoder {
+	private:
+		OutputEncoding encoding;
+		std::vector<float> curve;	// encoded value * 255 for value = i / (size - 1)
+		std::vector<std::vector<float>> ditherRows;	// per y % 8: threshold per channel of a row, in [0, 1)
+
+	public:
+		RowEncoder(const OutputEncoding& encoding, int width);
+
+		// count floats (count / 3 pixels) of row y to count bytes
+		void encodeRow(const float* rgb, int y, uint8_t* out, size_t count) const;
+};
+
+
+#endif //RAYTRACER_IMAGEENCODER_H
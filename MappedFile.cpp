@@ -0,0 +1,83 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAYTRACER_HAS_MMAP 1
+#endif
+
+MappedFile::MappedFile(const std::string& filename) {
+#ifdef RAYTRACER_HAS_MMAP
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Could not open file: " + filename);
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not stat file: " + filename);
+	}
+	length = static_cast<size_t>(info.st_size);
+	if (length > 0) {
+		void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, length, MADV_SEQUENTIAL);	// read once, front to back: aggressive read-ahead
+			bytes = static_cast<const uint8_t*>(mapping);
+			mapped = true;
+		}
+	}
+	close(fd);	// the mapping keeps the file open
+	if (mapped || length == 0) {
+		return;
+	}
+#endif
+	// No mmap (or it failed): one bulk read
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error("Could not open file: " + filename);
+	}
+	buffer.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+	bytes = buffer.data();
+	length = buffer.size();
+}
+
+MappedFile::~MappedFile() {
+	release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+		: bytes(other.bytes), length(other.length), mapped(other.mapped), buffer(std::move(other.buffer)) {
+	other.bytes = nullptr;
+	other.length = 0;
+	other.mapped = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		release();
+		bytes = other.bytes;
+		length = other.length;
+		mapped = other.mapped;
+		buffer = std::move(other.buffer);
+		other.bytes = nullptr;
+		other.length = 0;
+		other.mapped = false;
+	}
+	return *this;
+}
+
+void MappedFile::release() {
+#ifdef RAYTRACER_HAS_MMAP
+	if (mapped) munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+	bytes = nullptr;
+	length = 0;
+	mapped = false;
+}
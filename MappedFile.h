@@ -0,0 +1,35 @@
+#ifndef RAYTRACER_MAPPEDFILE_H
+#define RAYTRACER_MAPPEDFILE_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * A whole file, read-only, as one span of bytes. Mapped into memory where the platform allows,
+ * so only the pages that are touched are read and nothing is copied; elsewhere it is read in
+ * one go. Move-only; throws std::runtime_error if the file cannot be opened.
+ */
+class MappedFile {
+	private:
+		const uint8_t* bytes = nullptr;
+		size_t length = 0;
+		bool mapped = false;
+		std::vector<uint8_t> buffer;	// when not mapped
+
+		void release();
+
+	public:
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t* data() const { return bytes; }
+		size_t size() const { return length; }
+};
+
+
+#endif //RAYTRACER_MAPPEDFILE_H
@@ -21,12 +21,12 @@ Material::Material(float ks, float kd, int specularExponent,
 		 const Color& diffuseColor, const Color& specularColor,
 		 bool isReflective, float reflectivity,
 		 bool isRefractive, float refractiveIndex,
-		 const Image& texture)
+		 const Texture& texture)
 		: ks(ks), kd(kd), specularExponent(specularExponent),
 		  diffuseColor(diffuseColor), specularColor(specularColor),
 		  isReflective(isReflective), reflectivity(reflectivity),
 		  isRefractive(isRefractive), refractiveIndex(refractiveIndex),
-		  texture(texture), hasTexture(texture.getWidth() != 0 && texture.getHeight() != 0) {}
+		  texture(std::make_shared<const Texture>(texture)), hasTexture(texture.getWidth() != 0 && texture.getHeight() != 0) {}
 
 // Default Constructor
 Material::Material()
@@ -49,8 +49,12 @@ Color Material::getSpecularColor() const{ return specularColor; }
 
 // Texture-related methods
 bool Material::hasTextureMap() const { return hasTexture; }
-void Material::setTexture(Image& tex) {
+void Material::setTexture(const Texture& tex) {
+	setTexture(std::make_shared<const Texture>(tex));
+}
+void Material::setTexture(std::shared_ptr<const Texture> tex) {
 	texture = tex;
-	hasTexture = (tex.getWidth() != 0 && tex.getHeight() != 0);
+	hasTexture = (tex && tex->getWidth() != 0 && tex->getHeight() != 0);
 }
-const Image& Material::getTexture() const { return texture; }
+const Texture& Material::getTexture() const { return *texture; }
+std::shared_ptr<const Texture> Material::getTexturePtr() const { return texture; }
@@ -2,7 +2,8 @@
 #define RAYTRACER_MATERIAL_H
 #include "Vector3.h"
 #include "Color.h"
-#include "Image.h"
+#include "Texture.h"
+#include <memory>
 
 class Material {
 	private:
@@ -17,7 +18,7 @@ class Material {
 		float refractiveIndex;      // Refractive index
 
 		// Texture mapping attributes
-		Image texture;  // Pointer to texture image
+		std::shared_ptr<const Texture> texture;  // Pointer to texture, shared by every material using the file
 		bool hasTexture;                 // Indicates whether a texture is applied
 
 	public:
@@ -31,7 +32,7 @@ class Material {
 				 const Color& diffuseColor, const Color& specularColor,
 				 bool isReflective, float reflectivity,
 				 bool isRefractive, float refractiveIndex,
-				 const Image& texture);
+				 const Texture& texture);
 
 		// Default Constructor
 		Material();
@@ -48,8 +49,10 @@ class Material {
 
 		// Texture-related methods
 		bool hasTextureMap() const;
-		void setTexture(Image& tex);
-		const Image& getTexture() const;
+		void setTexture(const Texture& tex);
+		void setTexture(std::shared_ptr<const Texture> tex);
+		const Texture& getTexture() const;
+		std::shared_ptr<const Texture> getTexturePtr() const;
 };
 
 
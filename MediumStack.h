@@ -0,0 +1,44 @@
+#ifndef RAYTRACER_MEDIUMSTACK_H
+#define RAYTRACER_MEDIUMSTACK_H
+#include <array>
+#include <cassert>
+#include "Color.h"
+
+#define MAX_BOUNCES 16	// highest nbounces a scene may ask for; also bounds the medium stack
+
+/* A participating medium a ray can be inside of */
+struct Medium {
+	float refractiveIndex = 1.0f;
+	Color absorption;	// per unit distance, unused until absorption is shaded
+};
+
+/*
+ * Media the current ray is nested in, innermost on top. Lives inline (no heap), is passed down the
+ * ray tree by reference, and every push/pop is undone by the caller once the subtree is traced.
+ * Only refraction at depth < nbounces pushes, so nbounces <= MAX_BOUNCES entries always fit.
+ */
+class MediumStack {
+	private:
+		std::array<Medium, MAX_BOUNCES + 1> media;
+		int count = 0;
+
+	public:
+		bool empty() const { return count == 0; }
+		int size() const { return count; }
+		const Medium& top() const {
+			assert(count > 0);
+			return media[count - 1];
+		}
+
+		void push(const Medium& medium) {
+			assert(count < static_cast<int>(media.size()));
+			media[count++] = medium;
+		}
+		void pop() {
+			assert(count > 0);
+			--count;
+		}
+};
+
+
+#endif //RAYTRACER_MEDIUMSTACK_H
@@ -0,0 +1,120 @@
+#include "NumaTopology.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+	thread_local int pinnedNode = 0;
+
+	// Parses a sysfs CPU list such as "0-3,8-11"
+	std::vector<int> parseCpuList(const std::string& list) {
+		std::vector<int> cpus;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ',')) {
+			if (range.empty() || range == "\n") continue;
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+}
+
+NumaMode parseNumaMode(const std::string& name) {
+	if (name == "none") return NumaMode::None;
+	if (name == "pin") return NumaMode::Pin;
+	if (name == "firsttouch") return NumaMode::FirstTouch;
+	if (name == "replicate") return NumaMode::Replicate;
+	throw std::invalid_argument("Unknown NUMA mode: " + name);
+}
+
+std::string numaModeName(NumaMode mode) {
+	switch (mode) {
+		case NumaMode::Pin: return "pin";
+		case NumaMode::FirstTouch: return "firsttouch";
+		case NumaMode::Replicate: return "replicate";
+		default: return "none";
+	}
+}
+
+
+NumaTopology::NumaTopology() {
+#ifdef __linux__
+	for (int node = 0; ; ++node) {
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if (!file) break;
+		std::string list;
+		std::getline(file, list);
+		std::vector<int> cpus = parseCpuList(list);
+		if (!cpus.empty()) nodeCpus.push_back(cpus);	// memory-only nodes have no CPUs
+	}
+#endif
+	if (nodeCpus.empty()) {
+		std::vector<int> cpus;
+		int numCpus = std::max(1u, std::thread::hardware_concurrency());
+		for (int cpu = 0; cpu < numCpus; ++cpu) cpus.push_back(cpu);
+		nodeCpus.push_back(cpus);
+	}
+}
+
+int NumaTopology::getNumNodes() const { return static_cast<int>(nodeCpus.size()); }
+
+int NumaTopology::nodeForThread(int thread) const {
+	return thread % getNumNodes();
+}
+
+int NumaTopology::cpuForThread(int thread) const {
+	const std::vector<int>& cpus = nodeCpus[nodeForThread(thread)];
+	return cpus[(thread / getNumNodes()) % cpus.size()];
+}
+
+bool NumaTopology::pinCurrentThread(int thread) const {
+	pinnedNode = nodeForThread(thread);
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpuForThread(thread), &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+int NumaTopology::currentNode() { return pinnedNode; }
+
+
+ScopedPin::ScopedPin(const NumaTopology& topology, int thread, bool enabled) {
+	if (!enabled) return;
+	previousNode = pinnedNode;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &set)) previousCpus.push_back(cpu);
+		}
+	}
+#endif
+	topology.pinCurrentThread(thread);
+	pinned = true;
+}
+
+ScopedPin::~ScopedPin() {
+	if (!pinned) return;
+	pinnedNode = previousNode;
+#ifdef __linux__
+	if (previousCpus.empty()) return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : previousCpus) CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef RAYTRACER_NUMATOPOLOGY_H
+#define RAYTRACER_NUMATOPOLOGY_H
+#include <string>
+#include <vector>
+
+/* How render threads and memory are laid out on multi-socket machines */
+enum class NumaMode {
+	None,		// let the OS place threads; memory is first-touched by whoever loads/allocates it
+	Pin,		// pin render threads to CPUs, spread evenly over the NUMA nodes
+	FirstTouch,	// Pin + static tile ownership, framebuffer tiles first-touched by their owning thread
+	Replicate	// FirstTouch + a copy of the read-only scene data on every node
+};
+
+NumaMode parseNumaMode(const std::string& name);	// "none", "pin", "firsttouch" or "replicate"
+std::string numaModeName(NumaMode mode);
+
+
+/*
+ * NUMA nodes and their CPUs, read from /sys/devices/system/node on Linux.
+ * Elsewhere the machine is reported as a single node and pinning is a no-op.
+ */
+class NumaTopology {
+	private:
+		std::vector<std::vector<int>> nodeCpus;
+
+	public:
+		NumaTopology();	// detects the topology
+
+		int getNumNodes() const;
+		int nodeForThread(int thread) const;	// threads are dealt round-robin over the nodes
+		int cpuForThread(int thread) const;
+
+		// Pins the calling thread to cpuForThread(thread); returns false if the OS refused
+		bool pinCurrentThread(int thread) const;
+		static int currentNode();	// node the calling thread was pinned to, 0 if never pinned
+};
+
+
+/*
+ * Pins the calling thread for the lifetime of the object, then restores the affinity mask and node
+ * it had before. Pool threads (OpenMP, and anything they spawn, which inherits the mask) outlive a
+ * render, so a pin that is never undone would keep confining unrelated later work to one CPU.
+ */
+class ScopedPin {
+	private:
+		bool pinned = false;
+		int previousNode = 0;
+		std::vector<int> previousCpus;	// empty if the previous mask could not be read
+
+	public:
+		ScopedPin(const NumaTopology& topology, int thread, bool enabled = true);
+		~ScopedPin();
+		ScopedPin(const ScopedPin&) = delete;
+		ScopedPin& operator=(const ScopedPin&) = delete;
+};
+
+
+#endif //RAYTRACER_NUMATOPOLOGY_H
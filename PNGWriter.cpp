@@ -0,0 +1,352 @@
+#include "PNGWriter.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <omp.h>
+
+namespace {
+	const int windowSize = 32768;
+	const int hashBits = 15;
+	const int maxChain = 32;	// candidates tried per position: speed over ratio
+	const int minMatch = 3;
+	const int maxMatch = 258;
+
+	const int lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+								67, 83, 99, 115, 131, 163, 195, 227, 258};
+	const int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+								 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	const int distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+								  1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+	const int distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+								   9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+	std::array<uint32_t, 256> makeCrcTable() {
+		std::array<uint32_t, 256> table{};
+		for (uint32_t n = 0; n < 256; ++n) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		return table;
+	}
+
+	// Deflate bit stream: least significant bit first; Huffman codes go in most significant bit first
+	class BitWriter {
+		private:
+			std::vector<uint8_t>& out;
+			uint64_t bits = 0;
+			int count = 0;
+
+		public:
+			explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+			void put(uint32_t value, int length) {
+				bits |= static_cast<uint64_t>(value) << count;
+				count += length;
+				while (count >= 8) {
+					out.push_back(static_cast<uint8_t>(bits));
+					bits >>= 8;
+					count -= 8;
+				}
+			}
+			void putCode(uint32_t code, int length) {
+				uint32_t reversed = 0;
+				for (int i = 0; i < length; ++i) {
+					reversed = (reversed << 1) | ((code >> i) & 1);
+				}
+				put(reversed, length);
+			}
+			void alignToByte() {
+				if (count > 0) put(0, 8 - count);
+			}
+	};
+
+	// Fixed Huffman code of a literal/length symbol (RFC 1951, 3.2.6)
+	void putSymbol(BitWriter& writer, int symbol) {
+		if (symbol < 144) writer.putCode(0x30 + symbol, 8);
+		else if (symbol < 256) writer.putCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280) writer.putCode(symbol - 256, 7);
+		else writer.putCode(0xc0 + symbol - 280, 8);
+	}
+
+	void putMatch(BitWriter& writer, int length, int distance) {
+		int lengthCode = static_cast<int>(std::upper_bound(lengthBase, lengthBase + 29, length) - lengthBase) - 1;
+		putSymbol(writer, 257 + lengthCode);
+		writer.put(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+
+		int distanceCode = static_cast<int>(std::upper_bound(distanceBase, distanceBase + 30, distance) - distanceBase) - 1;
+		writer.putCode(distanceCode, 5);
+		writer.put(distance - distanceBase[distanceCode], distanceExtra[distanceCode]);
+	}
+
+	// One fixed-Huffman block over data, then a sync flush so the output ends on a byte boundary
+	void deflateBand(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+		BitWriter writer(out);
+		writer.put(0, 1);	// BFINAL: more blocks follow
+		writer.put(1, 2);	// BTYPE 01: fixed Huffman codes
+
+		int size = static_cast<int>(data.size());
+		std::vector<int> head(1 << hashBits, -1);
+		std::vector<int> previous(size);
+		auto hashAt = [&data](int pos) {
+			uint32_t key = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+			return static_cast<int>((key * 2654435761u) >> (32 - hashBits));
+		};
+		auto insert = [&](int pos) {
+			if (pos + minMatch > size) return;
+			int hash = hashAt(pos);
+			previous[pos] = head[hash];
+			head[hash] = pos;
+		};
+
+		int pos = 0;
+		while (pos < size) {
+			int bestLength = 0, bestDistance = 0;
+			if (pos + minMatch <= size) {
+				int limit = std::min(maxMatch, size - pos);
+				int candidate = head[hashAt(pos)];
+				for (int chain = 0; candidate >= 0 && pos - candidate <= windowSize && chain < maxChain; ++chain) {
+					if (data[candidate + bestLength] == data[pos + bestLength]) {
+						int length = 0;
+						while (length < limit && data[candidate + length] == data[pos + length]) ++length;
+						if (length > bestLength) {
+							bestLength = length;
+							bestDistance = pos - candidate;
+							if (length == limit) break;
+						}
+					}
+					candidate = previous[candidate];
+				}
+			}
+
+			if (bestLength >= minMatch) {
+				putMatch(writer, bestLength, bestDistance);
+				for (int i = 0; i < bestLength; ++i) insert(pos + i);
+				pos += bestLength;
+			} else {
+				putSymbol(writer, data[pos]);
+				insert(pos);
+				++pos;
+			}
+		}
+		putSymbol(writer, 256);	// end of block
+
+		// sync flush: empty stored block, which starts on the next byte boundary
+		writer.put(0, 1);
+		writer.put(0, 2);
+		writer.alignToByte();
+		out.insert(out.end(), {0x00, 0x00, 0xff, 0xff});
+	}
+
+	int paeth(int a, int b, int c) {
+		int p = a + b - c;
+		int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) return a;
+		if (pb <= pc) return b;
+		return c;
+	}
+
+	// Filter type byte + filtered row, picking the filter with the smallest sum of |signed bytes|.
+	// candidate is the caller's scratch row of rowBytes bytes
+	void filterRow(const uint8_t* row, const uint8_t* above, int rowBytes, uint8_t* out, uint8_t* candidate) {
+		const int bpp = 3;
+		long bestScore = -1;
+		for (int filter = 0; filter < 5; ++filter) {
+			long score = 0;
+			for (int i = 0; i < rowBytes; ++i) {
+				int left = i >= bpp ? row[i - bpp] : 0;
+				int up = above ? above[i] : 0;
+				int upLeft = (above && i >= bpp) ? above[i - bpp] : 0;
+				int predicted = 0;
+				switch (filter) {
+					case 1: predicted = left; break;
+					case 2: predicted = up; break;
+					case 3: predicted = (left + up) / 2; break;
+					case 4: predicted = paeth(left, up, upLeft); break;
+				}
+				uint8_t value = static_cast<uint8_t>(row[i] - predicted);
+				candidate[i] = value;
+				score += value < 128 ? value : 256 - value;
+			}
+			if (bestScore < 0 || score < bestScore) {
+				bestScore = score;
+				out[0] = static_cast<uint8_t>(filter);
+				std::copy(candidate, candidate + rowBytes, out + 1);
+			}
+		}
+	}
+
+	void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+		out.insert(out.end(), {static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+							   static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)});
+	}
+
+	// Length + type + data + CRC; the CRC is computed by the caller's thread
+	std::vector<uint8_t> makeChunk(const char* type, const std::vector<uint8_t>& data) {
+		std::vector<uint8_t> chunk;
+		chunk.reserve(data.size() + 12);
+		putBigEndian(chunk, static_cast<uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		putBigEndian(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+		return chunk;
+	}
+}
+
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length) {
+	static const std::array<uint32_t, 256> table = makeCrcTable();
+	crc = ~crc;
+	for (size_t i = 0; i < length; ++i) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+uint32_t adler32(uint32_t adler, const uint8_t* data, size_t length) {
+	const uint32_t base = 65521;
+	uint32_t a = adler & 0xffff, b = adler >> 16;
+	while (length > 0) {
+		size_t block = std::min<size_t>(length, 5552);	// largest run before b can overflow 32 bits
+		for (size_t i = 0; i < block; ++i) {
+			a += data[i];
+			b += a;
+		}
+		a %= base;
+		b %= base;
+		data += block;
+		length -= block;
+	}
+	return a | (b << 16);
+}
+
+uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+	const uint32_t base = 65521;
+	uint32_t remainder = static_cast<uint32_t>(length2 % base);
+	uint32_t sum1 = adler1 & 0xffff;
+	uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * sum1) % base);
+	sum1 += (adler2 & 0xffff) + base - 1;
+	sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - remainder;
+	if (sum1 >= base) sum1 -= base;
+	if (sum1 >= base) sum1 -= base;
+	if (sum2 >= base * 2) sum2 -= base * 2;
+	if (sum2 >= base) sum2 -= base;
+	return sum1 | (sum2 << 16);
+}
+
+
+PNGStream::PNGStream(const std::string& filename, int width, int height, int threads)
+		: file(filename, std::ios::binary), height(height), threads(threads > 0 ? threads : omp_get_max_threads()),
+		  rowBytes(static_cast<size_t>(width) * 3) {
+	if (!file) {
+		return;
+	}
+
+	const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<uint8_t> header;
+	putBigEndian(header, static_cast<uint32_t>(width));
+	putBigEndian(header, static_cast<uint32_t>(height));
+	header.insert(header.end(), {8, 2, 0, 0, 0});	// 8 bits, RGB, deflate, adaptive filtering, no interlace
+	std::vector<uint8_t> chunk = makeChunk("IHDR", header);
+	file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+}
+
+bool PNGStream::good() const { return file.good(); }
+
+int PNGStream::getRowsWritten() const { return rowsWritten; }
+
+void PNGStream::writeRows(const uint8_t* rgb, int count) {
+	// Top up a partial band left by the previous call first, so bands never depend on how rows arrive
+	int buffered = static_cast<int>(pending.size() / rowBytes);
+	if (buffered > 0) {
+		int take = std::min(count, bandRows - buffered);
+		pending.insert(pending.end(), rgb, rgb + take * rowBytes);
+		rgb += take * rowBytes;
+		count -= take;
+		if (static_cast<int>(pending.size() / rowBytes) < bandRows) return;
+		std::vector<uint8_t> band;
+		band.swap(pending);
+		compressBands(band.data(), bandRows);
+	}
+
+	int whole = count / bandRows * bandRows;
+	if (whole > 0) compressBands(rgb, whole);
+	pending.assign(rgb + whole * rowBytes, rgb + count * rowBytes);
+}
+
+void PNGStream::compressBands(const uint8_t* rgb, int rows) {
+	int numBands = (rows + bandRows - 1) / bandRows;
+	int firstRow = rowsWritten;
+	const uint8_t* previous = previousRow.empty() ? nullptr : previousRow.data();	// row above rgb, if any
+	std::vector<std::vector<uint8_t>> idats(numBands);
+	std::vector<uint32_t> adlers(numBands);
+	std::vector<size_t> filteredSizes(numBands);
+	// Filter + deflate + checksum every band in parallel
+	#pragma omp parallel for schedule(dynamic) num_threads(threads)
+	for (int band = 0; band < numBands; ++band) {
+		int y0 = band * bandRows;
+		int y1 = std::min(y0 + bandRows, rows);
+		std::vector<uint8_t> filtered((y1 - y0) * (rowBytes + 1));
+		std::vector<uint8_t> candidate(rowBytes);	// one scratch row for the whole band
+		for (int y = y0; y < y1; ++y) {
+			const uint8_t* above = y > 0 ? rgb + (y - 1) * rowBytes : previous;	// the previous row of the image, even across bands
+			filterRow(rgb + y * rowBytes, above, static_cast<int>(rowBytes), filtered.data() + (y - y0) * (rowBytes + 1),
+					  candidate.data());
+		}
+		adlers[band] = adler32(1, filtered.data(), filtered.size());
+		filteredSizes[band] = filtered.size();
+
+		std::vector<uint8_t> compressed;
+		if (firstRow + y0 == 0) compressed = {0x78, 0x01};	// zlib header: deflate, 32K window, fastest
+		deflateBand(filtered, compressed);
+		idats[band] = makeChunk("IDAT", compressed);
+	}
+	for (int band = 0; band < numBands; ++band) {
+		file.write(reinterpret_cast<const char*>(idats[band].data()), static_cast<std::streamsize>(idats[band].size()));
+		adler = adler32Combine(adler, adlers[band], filteredSizes[band]);
+	}
+	file.flush();
+
+	previousRow.assign(rgb + (rows - 1) * rowBytes, rgb + rows * rowBytes);
+	rowsWritten += rows;
+}
+
+bool PNGStream::finish() {
+	if (!pending.empty()) {
+		std::vector<uint8_t> band;
+		band.swap(pending);
+		compressBands(band.data(), static_cast<int>(band.size() / rowBytes));
+	}
+	if (rowsWritten != height) {
+		return false;
+	}
+
+	// Final empty fixed-Huffman block, then the adler32 of all filtered rows
+	std::vector<uint8_t> trailer;
+	if (height == 0) trailer = {0x78, 0x01};
+	trailer.insert(trailer.end(), {0x03, 0x00});
+	putBigEndian(trailer, adler);
+	std::vector<uint8_t> chunk = makeChunk("IDAT", trailer);
+	file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+
+	chunk = makeChunk("IEND", {});
+	file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+	file.flush();
+	return file.good();
+}
+
+
+bool writePNG(const std::string& filename, const uint8_t* rgb, int width, int height) {
+	PNGStream stream(filename, width, height);
+	if (!stream.good()) {
+		return false;
+	}
+	stream.writeRows(rgb, height);
+	return stream.finish();
+}
@@ -0,0 +1,54 @@
+#ifndef RAYTRACER_PNGWRITER_H
+#define RAYTRACER_PNGWRITER_H
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Writes 8-bit RGB rows as a PNG, without zlib.
+ * The image is cut into bands of rows that are filtered and deflated independently on all
+ * threads: every band is a fixed-Huffman LZ77 stream ended by a sync flush (an empty stored
+ * block), so the bands concatenate byte-aligned into one valid zlib stream. Each band goes
+ * into its own IDAT chunk with its CRC computed by the same thread, and the per-band adler32
+ * checksums are combined for the zlib trailer.
+ */
+bool writePNG(const std::string& filename, const uint8_t* rgb, int width, int height);
+
+/*
+ * The same encoder fed top to bottom: rows can arrive in pieces of any size (e.g. as a render
+ * finishes them) and every complete band is compressed and appended to the file right away.
+ * The file is the same as writePNG's however the rows were split.
+ */
+class PNGStream {
+	private:
+		static const int bandRows = 32;	// rows per independently compressed band
+
+		std::ofstream file;
+		int height;
+		int threads;	// compressing the bands of one writeRows call
+		size_t rowBytes;	// 3 * width
+		int rowsWritten = 0;
+		uint32_t adler = 1;	// of all filtered rows so far
+		std::vector<uint8_t> previousRow;	// last row compressed, the "above" of the next band
+		std::vector<uint8_t> pending;	// rows of an incomplete band
+
+		void compressBands(const uint8_t* rgb, int rows);
+
+	public:
+		// Writes the signature and IHDR. threads 0 compresses on the whole OpenMP team; a stream fed
+		// while a render keeps every core busy should use 1
+		PNGStream(const std::string& filename, int width, int height, int threads = 0);
+
+		bool good() const;
+		int getRowsWritten() const;	// rows compressed into the file (excludes a buffered partial band)
+		void writeRows(const uint8_t* rgb, int count);	// the next count rows of 3 * width bytes
+		bool finish();	// flushes the last band and closes the zlib stream; false unless all rows were given
+};
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length);	// start with crc = 0
+uint32_t adler32(uint32_t adler, const uint8_t* data, size_t length);	// start with adler = 1
+uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2);	// as if the data were concatenated
+
+
+#endif //RAYTRACER_PNGWRITER_H
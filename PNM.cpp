@@ -0,0 +1,169 @@
+#include "PNM.h"
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+	bool skipSeparators(const uint8_t* data, size_t size, size_t& pos) {
+		while (pos < size) {
+			if (data[pos] == '#') {
+				while (pos < size && data[pos] != '\n') ++pos;
+			} else if (std::isspace(data[pos])) {
+				++pos;
+			} else {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Four samples at once: (sample * 255 + maxValue / 2) / maxValue, truncated. Every step is exact
+	// in float (sample * 255 + maxValue / 2 < 2^24), so the result equals pnmSampleToByte's.
+#if defined(__SSE2__)
+	inline __m128i scaleSamples(__m128i samples, __m128 halfMax, __m128 maxValue) {
+		__m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(samples), _mm_set1_ps(255.0f)), halfMax);
+		return _mm_cvttps_epi32(_mm_div_ps(scaled, maxValue));
+	}
+
+	inline void storeBytes(uint8_t* out, __m128i a, __m128i b, __m128i c, __m128i d) {
+		__m128i words = _mm_packs_epi32(a, b), words2 = _mm_packs_epi32(c, d);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(words, words2));
+	}
+#elif defined(__aarch64__)
+	inline uint16x4_t scaleSamples(uint32x4_t samples, float32x4_t halfMax, float32x4_t maxValue) {
+		float32x4_t scaled = vaddq_f32(vmulq_n_f32(vcvtq_f32_u32(samples), 255.0f), halfMax);
+		return vmovn_u32(vcvtq_u32_f32(vdivq_f32(scaled, maxValue)));
+	}
+#endif
+
+	void expandSamples8(const uint8_t* in, uint8_t* out, size_t count, uint32_t maxValue) {
+		if (maxValue == 255) {
+			std::memcpy(out, in, count);
+			return;
+		}
+		size_t i = 0;
+#if defined(__SSE2__)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 divisor = _mm_set1_ps(static_cast<float>(maxValue));
+		const __m128 halfMax = _mm_set1_ps(static_cast<float>(maxValue / 2));
+		for (; i + 16 <= count; i += 16) {
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128i low = _mm_unpacklo_epi8(bytes, zero), high = _mm_unpackhi_epi8(bytes, zero);
+			storeBytes(out + i,
+					   scaleSamples(_mm_unpacklo_epi16(low, zero), halfMax, divisor),
+					   scaleSamples(_mm_unpackhi_epi16(low, zero), halfMax, divisor),
+					   scaleSamples(_mm_unpacklo_epi16(high, zero), halfMax, divisor),
+					   scaleSamples(_mm_unpackhi_epi16(high, zero), halfMax, divisor));
+		}
+#elif defined(__aarch64__)
+		const float32x4_t divisor = vdupq_n_f32(static_cast<float>(maxValue));
+		const float32x4_t halfMax = vdupq_n_f32(static_cast<float>(maxValue / 2));
+		for (; i + 16 <= count; i += 16) {
+			uint8x16_t bytes = vld1q_u8(in + i);
+			uint16x8_t low = vmovl_u8(vget_low_u8(bytes)), high = vmovl_u8(vget_high_u8(bytes));
+			uint16x8_t low16 = vcombine_u16(scaleSamples(vmovl_u16(vget_low_u16(low)), halfMax, divisor),
+											scaleSamples(vmovl_u16(vget_high_u16(low)), halfMax, divisor));
+			uint16x8_t high16 = vcombine_u16(scaleSamples(vmovl_u16(vget_low_u16(high)), halfMax, divisor),
+											 scaleSamples(vmovl_u16(vget_high_u16(high)), halfMax, divisor));
+			vst1q_u8(out + i, vcombine_u8(vmovn_u16(low16), vmovn_u16(high16)));
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] = pnmSampleToByte(in[i], maxValue);
+		}
+	}
+
+	// 16-bit samples are big-endian; they are rounded to 8 bits
+	void expandSamples16(const uint8_t* in, uint8_t* out, size_t count, uint32_t maxValue) {
+		size_t i = 0;
+#if defined(__SSE2__)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 divisor = _mm_set1_ps(static_cast<float>(maxValue));
+		const __m128 halfMax = _mm_set1_ps(static_cast<float>(maxValue / 2));
+		for (; i + 16 <= count; i += 16) {
+			__m128i words[2];
+			for (int half = 0; half < 2; ++half) {
+				__m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * (i + 8 * half)));
+				words[half] = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));	// byte swap
+			}
+			storeBytes(out + i,
+					   scaleSamples(_mm_unpacklo_epi16(words[0], zero), halfMax, divisor),
+					   scaleSamples(_mm_unpackhi_epi16(words[0], zero), halfMax, divisor),
+					   scaleSamples(_mm_unpacklo_epi16(words[1], zero), halfMax, divisor),
+					   scaleSamples(_mm_unpackhi_epi16(words[1], zero), halfMax, divisor));
+		}
+#elif defined(__aarch64__)
+		const float32x4_t divisor = vdupq_n_f32(static_cast<float>(maxValue));
+		const float32x4_t halfMax = vdupq_n_f32(static_cast<float>(maxValue / 2));
+		for (; i + 8 <= count; i += 8) {
+			uint16x8_t words = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(in + 2 * i)));	// byte swap
+			uint16x8_t scaled = vcombine_u16(scaleSamples(vmovl_u16(vget_low_u16(words)), halfMax, divisor),
+											 scaleSamples(vmovl_u16(vget_high_u16(words)), halfMax, divisor));
+			vst1_u8(out + i, vmovn_u16(scaled));
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] = pnmSampleToByte((in[2 * i] << 8) | in[2 * i + 1], maxValue);
+		}
+	}
+}
+
+bool readPNMNumber(const uint8_t* data, size_t size, size_t& pos, int& value) {
+	if (!skipSeparators(data, size, pos) || !std::isdigit(data[pos])) return false;
+	long long number = 0;
+	while (pos < size && std::isdigit(data[pos])) {
+		number = number * 10 + (data[pos++] - '0');
+		if (number > 0x7fffffff) return false;
+	}
+	value = static_cast<int>(number);
+	return true;
+}
+
+bool parsePNMHeader(const uint8_t* data, size_t size, PNMHeader& header) {
+	if (size < 2 || data[0] != 'P' || !std::strchr("2356", data[1])) return false;
+	header.kind = static_cast<char>(data[1]);
+	size_t pos = 2;
+	if (!readPNMNumber(data, size, pos, header.width) || !readPNMNumber(data, size, pos, header.height) ||
+		!readPNMNumber(data, size, pos, header.maxValue)) {
+		return false;
+	}
+	if (header.width <= 0 || header.height <= 0 || header.maxValue <= 0 || header.maxValue > 65535) return false;
+	header.dataOffset = pos + 1;	// the single whitespace after maxval
+	return pos < size && std::isspace(data[pos]);
+}
+
+void expandPNMSamples(const uint8_t* in, uint8_t* out, size_t count, const PNMHeader& header) {
+	uint32_t maxValue = static_cast<uint32_t>(header.maxValue);
+	if (header.sampleBytes() == 2) {
+		expandSamples16(in, out, count, maxValue);
+	} else {
+		expandSamples8(in, out, count, maxValue);
+	}
+}
+
+void pnmRowToRGBA8(const uint8_t* in, uint8_t* scratch, uint8_t* rgba, const PNMHeader& header) {
+	size_t width = static_cast<size_t>(header.width);
+	const uint8_t* samples = in;
+	if (header.maxValue != 255) {
+		expandPNMSamples(in, scratch, width * header.channels(), header);
+		samples = scratch;
+	}
+	if (header.isGray()) {
+		for (size_t x = 0; x < width; ++x, rgba += 4) {
+			rgba[0] = rgba[1] = rgba[2] = samples[x];
+			rgba[3] = 255;
+		}
+	} else {
+		for (size_t x = 0; x < width; ++x, rgba += 4, samples += 3) {
+			rgba[0] = samples[0];
+			rgba[1] = samples[1];
+			rgba[2] = samples[2];
+			rgba[3] = 255;
+		}
+	}
+}
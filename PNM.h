@@ -0,0 +1,43 @@
+#ifndef RAYTRACER_PNM_H
+#define RAYTRACER_PNM_H
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Netpbm decoding shared by every reader of P2 / P3 / P5 / P6 files.
+ * Everything here produces 8 bits per channel: samples of 16-bit files (maxval > 255) are
+ * rounded to the nearest 8-bit value and their low bits are lost. Callers that keep 8-bit
+ * texels say so in their own documentation.
+ */
+
+// Header: magic, width, height, maxval, separated by whitespace and # comments
+struct PNMHeader {
+	char kind = 0;	// '2', '3', '5' or '6'
+	int width = 0;
+	int height = 0;
+	int maxValue = 0;
+	size_t dataOffset = 0;	// first byte of the samples
+
+	bool isGray() const { return kind == '2' || kind == '5'; }
+	bool isASCII() const { return kind == '2' || kind == '3'; }
+	size_t channels() const { return isGray() ? 1 : 3; }
+	size_t sampleBytes() const { return maxValue > 255 ? 2 : 1; }	// binary formats
+	size_t rowBytes() const { return static_cast<size_t>(width) * channels() * sampleBytes(); }
+};
+
+bool parsePNMHeader(const uint8_t* data, size_t size, PNMHeader& header);	// false if malformed
+bool readPNMNumber(const uint8_t* data, size_t size, size_t& pos, int& value);	// next ASCII sample
+
+// Sample of maxValue to 8 bits, rounded to nearest (maxValue 255 is the identity)
+inline uint8_t pnmSampleToByte(uint32_t sample, uint32_t maxValue) {
+	return maxValue == 255 ? static_cast<uint8_t>(sample) : static_cast<uint8_t>((sample * 255 + maxValue / 2) / maxValue);
+}
+
+// count samples of a binary row (big-endian if 16-bit) to bytes, 16 at a time with SSE2 / NEON
+void expandPNMSamples(const uint8_t* in, uint8_t* out, size_t count, const PNMHeader& header);
+
+// One binary row to RGBA8 (gray is replicated, alpha 255); scratch holds width * channels bytes
+void pnmRowToRGBA8(const uint8_t* in, uint8_t* scratch, uint8_t* rgba, const PNMHeader& header);
+
+
+#endif //RAYTRACER_PNM_H
@@ -0,0 +1,41 @@
+#ifndef RAYTRACER_PATHQUEUE_H
+#define RAYTRACER_PATHQUEUE_H
+#include <array>
+#include <cassert>
+#include "Ray.h"
+#include "MediumStack.h"
+
+/* A ray still to be traced: everything the recursive traceRay kept in its stack frame */
+struct PathState {
+	Ray ray = Ray(Vector3(), Vector3());
+	int depth = 0;
+	float weight = 1.0f;	// how much this ray's radiance adds to the pixel
+	MediumStack media;	// media the ray starts in
+};
+
+/*
+ * Rays waiting to be traced for one pixel, popped newest first so the ray tree is walked depth first.
+ * Every pop pushes at most two children, one of which is popped next, so at most one sibling per
+ * depth is ever waiting and MAX_BOUNCES + 2 entries always fit. Fixed size: no heap while tracing.
+ */
+class PathQueue {
+	private:
+		std::array<PathState, MAX_BOUNCES + 2> paths;
+		int count = 0;
+
+	public:
+		bool empty() const { return count == 0; }
+		void clear() { count = 0; }
+
+		void push(const PathState& path) {
+			assert(count < static_cast<int>(paths.size()));
+			paths[count++] = path;
+		}
+		PathState pop() {
+			assert(count > 0);
+			return paths[--count];
+		}
+};
+
+
+#endif //RAYTRACER_PATHQUEUE_H
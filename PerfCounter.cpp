@@ -0,0 +1,57 @@
+#include "PerfCounter.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+PerfCounter::PerfCounter() {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.inherit = 1;	// include threads spawned later (OpenMP team, scheduler workers)
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	if (fd < 0) {
+		// some CPUs/VMs have no LL cache event: fall back to the generic cache-miss event
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+}
+
+PerfCounter::~PerfCounter() {
+	if (fd >= 0) close(fd);
+}
+
+void PerfCounter::start() {
+	if (fd < 0) return;
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+long long PerfCounter::stop() {
+	if (fd < 0) return -1;
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	long long count = 0;
+	if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+	return count;
+}
+
+#else
+
+PerfCounter::PerfCounter() {}
+PerfCounter::~PerfCounter() {}
+void PerfCounter::start() {}
+long long PerfCounter::stop() { return -1; }
+
+#endif
+
+bool PerfCounter::isAvailable() const { return fd >= 0; }
@@ -0,0 +1,25 @@
+#ifndef RAYTRACER_PERFCOUNTER_H
+#define RAYTRACER_PERFCOUNTER_H
+
+/*
+ * Last-level-cache miss counter for benchmarks, backed by Linux perf events.
+ * Counts the calling thread and every thread it creates afterwards, so construct it
+ * before the first parallel region. Elsewhere (or without permission) isAvailable() is false.
+ */
+class PerfCounter {
+	private:
+		int fd = -1;
+
+	public:
+		PerfCounter();
+		~PerfCounter();
+		PerfCounter(const PerfCounter&) = delete;
+		PerfCounter& operator=(const PerfCounter&) = delete;
+
+		bool isAvailable() const;
+		void start();		// reset and enable counting
+		long long stop();	// disable counting and return the misses since start(), -1 if unavailable
+};
+
+
+#endif //RAYTRACER_PERFCOUNTER_H
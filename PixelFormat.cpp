@@ -0,0 +1,80 @@
+#include "PixelFormat.h"
+#include <stdexcept>
+
+PixelFormat parsePixelFormat(const std::string& name) {
+	if (name == "rgb32f") return PixelFormat::RGB32F;
+	if (name == "rgb16f") return PixelFormat::RGB16F;
+	if (name == "rgbe") return PixelFormat::RGBE;
+	if (name == "rgb8") return PixelFormat::RGB8;
+	throw std::invalid_argument("Unknown pixel format: " + name);
+}
+
+std::string pixelFormatName(PixelFormat format) {
+	switch (format) {
+		case PixelFormat::RGB16F: return "rgb16f";
+		case PixelFormat::RGBE: return "rgbe";
+		case PixelFormat::RGB8: return "rgb8";
+		default: return "rgb32f";
+	}
+}
+
+int bytesPerPixel(PixelFormat format) {
+	switch (format) {
+		case PixelFormat::RGB16F: return 6;
+		case PixelFormat::RGBE: return 4;
+		case PixelFormat::RGB8: return 3;
+		default: return 12;
+	}
+}
+
+
+uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	int exponent = static_cast<int>((bits >> 23) & 0xffu) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffffu;
+
+	if (((bits >> 23) & 0xffu) == 0xffu) {
+		return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));	// inf / nan
+	}
+	if (exponent >= 0x1f) {
+		return static_cast<uint16_t>(sign | 0x7c00u);	// too big: inf
+	}
+	if (exponent <= 0) {
+		// denormal half (or zero)
+		if (exponent < -10) return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000u;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1u))) ++half;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fffu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) ++half;	// a carry into the exponent is still correct
+	return static_cast<uint16_t>(sign | half);
+}
+
+float halfToFloat(uint16_t half) {
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+	uint32_t exponent = (half >> 10) & 0x1fu;
+	uint32_t mantissa = half & 0x3ffu;
+
+	uint32_t bits;
+	if (exponent == 0x1f) {
+		bits = sign | 0x7f800000u | (mantissa << 13);
+	} else if (exponent == 0) {
+		float value = static_cast<float>(mantissa) * (1.0f / 16777216.0f);	// denormal: mantissa * 2^-24
+		std::memcpy(&bits, &value, sizeof(bits));
+		bits |= sign;
+	} else {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
@@ -0,0 +1,129 @@
+#ifndef RAYTRACER_PIXELFORMAT_H
+#define RAYTRACER_PIXELFORMAT_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "Color.h"
+
+#if defined(__F16C__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * How an Image stores its pixels. Half float and RGBE trade precision for memory: both are
+ * still well below one step of the 8-bit PPM we write out (RGBE keeps 8 bits of mantissa
+ * relative to the brightest channel, half floats 11 bits per channel).
+ */
+enum class PixelFormat {
+	RGB32F,	// 12 bytes: three floats, exact
+	RGB16F,	// 6 bytes: three IEEE half floats
+	RGBE,	// 4 bytes: 8-bit mantissas sharing one exponent (Ward's Radiance format); no negatives
+	RGB8	// 3 bytes: the final tone-mapped 8-bit value, laid out like PPM P6 pixel data
+};
+
+PixelFormat parsePixelFormat(const std::string& name);	// "rgb32f", "rgb16f", "rgbe" or "rgb8"
+std::string pixelFormatName(PixelFormat format);
+int bytesPerPixel(PixelFormat format);
+
+// Scalar IEEE half conversions (round to nearest even), for CPUs without F16C/NEON
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t half);
+
+
+/*
+ * Pack/unpack one pixel. Uses F16C or NEON for the half conversions and SSE2/NEON for the
+ * RGBE scaling when the compiler targets them (e.g. -mf16c or -march=native on x86).
+ */
+inline void encodeHalf(const Color& color, uint8_t* out) {
+	uint16_t halves[4];
+#if defined(__F16C__)
+	__m128i packed = _mm_cvtps_ph(_mm_set_ps(0.0f, color.getB(), color.getG(), color.getR()), _MM_FROUND_TO_NEAREST_INT);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(halves), packed);
+#elif defined(__aarch64__)
+	float lanes[4] = {color.getR(), color.getG(), color.getB(), 0.0f};
+	vst1_u16(halves, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(lanes))));
+#else
+	halves[0] = floatToHalf(color.getR());
+	halves[1] = floatToHalf(color.getG());
+	halves[2] = floatToHalf(color.getB());
+#endif
+	std::memcpy(out, halves, 6);
+}
+
+inline Color decodeHalf(const uint8_t* in) {
+	uint16_t halves[4] = {0, 0, 0, 0};
+	std::memcpy(halves, in, 6);
+#if defined(__F16C__)
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(halves))));
+	return Color(lanes[0], lanes[1], lanes[2]);
+#elif defined(__aarch64__)
+	float lanes[4];
+	vst1q_f32(lanes, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(halves))));
+	return Color(lanes[0], lanes[1], lanes[2]);
+#else
+	return Color(halfToFloat(halves[0]), halfToFloat(halves[1]), halfToFloat(halves[2]));
+#endif
+}
+
+inline void encodeRGBE(const Color& color, uint8_t* out) {
+	float r = std::max(color.getR(), 0.0f), g = std::max(color.getG(), 0.0f), b = std::max(color.getB(), 0.0f);
+	float brightest = std::max(r, std::max(g, b));
+	if (brightest < 1e-32f) {
+		std::memset(out, 0, 4);
+		return;
+	}
+	int exponent;
+	// brightest channel -> [128, 256); rounding in scale can still land it on 256, which every path clamps to 255
+	float scale = std::frexp(brightest, &exponent) * 256.0f / brightest;
+#if defined(__SSE2__)
+	__m128i mantissas = _mm_cvttps_epi32(_mm_mul_ps(_mm_set_ps(0.0f, b, g, r), _mm_set1_ps(scale)));
+	mantissas = _mm_packus_epi16(_mm_packs_epi32(mantissas, mantissas), mantissas);
+	uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(mantissas));
+	std::memcpy(out, &packed, 3);
+#elif defined(__aarch64__)
+	float lanes[4] = {r, g, b, 0.0f};
+	uint32x4_t mantissas = vminq_u32(vcvtq_u32_f32(vmulq_n_f32(vld1q_f32(lanes), scale)), vdupq_n_u32(255));
+	uint8_t bytes[8];
+	vst1_u8(bytes, vmovn_u16(vcombine_u16(vmovn_u32(mantissas), vdup_n_u16(0))));
+	std::memcpy(out, bytes, 3);
+#else
+	out[0] = static_cast<uint8_t>(std::min(r * scale, 255.0f));
+	out[1] = static_cast<uint8_t>(std::min(g * scale, 255.0f));
+	out[2] = static_cast<uint8_t>(std::min(b * scale, 255.0f));
+#endif
+	out[3] = static_cast<uint8_t>(exponent + 128);
+}
+
+inline Color decodeRGBE(const uint8_t* in) {
+	if (in[3] == 0) {
+		return Color(0.0f, 0.0f, 0.0f);
+	}
+	float scale = std::ldexp(1.0f, static_cast<int>(in[3]) - (128 + 8));
+	// +0.5: reconstruct the middle of each mantissa step
+#if defined(__SSE2__)
+	uint32_t packed;
+	std::memcpy(&packed, in, 4);
+	__m128i zero = _mm_setzero_si128();
+	__m128i mantissas = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(packed)), zero), zero);
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(mantissas), _mm_set1_ps(0.5f)), _mm_set1_ps(scale)));
+	return Color(lanes[0], lanes[1], lanes[2]);
+#elif defined(__aarch64__)
+	uint8_t bytes[8] = {in[0], in[1], in[2], 0, 0, 0, 0, 0};
+	uint32x4_t mantissas = vmovl_u16(vget_low_u16(vmovl_u8(vld1_u8(bytes))));
+	float lanes[4];
+	vst1q_f32(lanes, vmulq_n_f32(vaddq_f32(vcvtq_f32_u32(mantissas), vdupq_n_f32(0.5f)), scale));
+	return Color(lanes[0], lanes[1], lanes[2]);
+#else
+	return Color((in[0] + 0.5f) * scale, (in[1] + 0.5f) * scale, (in[2] + 0.5f) * scale);
+#endif
+}
+
+
+#endif //RAYTRACER_PIXELFORMAT_H
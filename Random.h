@@ -0,0 +1,65 @@
+#ifndef RAYTRACER_RANDOM_H
+#define RAYTRACER_RANDOM_H
+#include <array>
+#include <cstdint>
+
+/*
+ * Philox4x32-10 counter-based random numbers (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+ * The output is a pure function of (counter, key): nothing is carried between calls, so a sample
+ * gets the same random numbers whichever thread traces it and in whatever order.
+ */
+class Philox {
+	public:
+		using Counter = std::array<uint32_t, 4>;
+		using Key = std::array<uint32_t, 2>;
+
+		static Counter generate(Counter counter, Key key) {
+			for (int round = 0; round < 10; ++round) {
+				if (round > 0) {
+					key[0] += 0x9E3779B9u;
+					key[1] += 0xBB67AE85u;
+				}
+				uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+				uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+				counter = {
+						static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+						static_cast<uint32_t>(product1),
+						static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+						static_cast<uint32_t>(product0)
+				};
+			}
+			return counter;
+		}
+};
+
+
+/*
+ * Random numbers for one (pixel, sample, bounce) of a render. Dimensions 0-3 come from one
+ * Philox block, 4-7 from the next, and so on.
+ */
+class SampleRandom {
+	private:
+		uint64_t pixel;
+		uint32_t sample;
+		uint32_t bounce;
+		uint32_t seed;
+
+	public:
+		SampleRandom(uint64_t pixel, uint32_t sample, uint32_t bounce, uint32_t seed = 0)
+				: pixel(pixel), sample(sample), bounce(bounce), seed(seed) {}
+
+		// Uniform float in [0, 1) for the given dimension
+		float uniform(uint32_t dimension) const {
+			Philox::Counter counter = {
+					static_cast<uint32_t>(pixel),
+					static_cast<uint32_t>(pixel >> 32),
+					sample,
+					(bounce << 16) | (dimension >> 2)
+			};
+			Philox::Counter block = Philox::generate(counter, {seed, 0x5eed5eedu});
+			return static_cast<float>(block[dimension & 3] >> 8) * (1.0f / 16777216.0f);	// top 24 bits
+		}
+};
+
+
+#endif //RAYTRACER_RANDOM_H
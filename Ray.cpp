@@ -2,6 +2,8 @@
 
 // constructor
 Ray::Ray(Vector3 origin, Vector3 direction) : origin(origin), direction(direction) {}
+Ray::Ray(Vector3 origin, Vector3 direction, float coneWidth, float coneSpread)
+		: origin(origin), direction(direction), coneWidth(coneWidth), coneSpread(coneSpread) {}
 
 // destructor
 Ray::~Ray(){}
@@ -10,7 +12,17 @@ Vector3 Ray::pointAtParameter(float t) const {
 	return origin + direction * t;
 }
 
+float Ray::coneWidthAt(float t) const {
+	return coneWidth + t * coneSpread;
+}
+
+Ray Ray::continuation(Vector3 newOrigin, Vector3 newDirection, float t) const {
+	return Ray(newOrigin, newDirection, coneWidthAt(t), coneSpread);
+}
+
 //getters
 Vector3 Ray::getOrigin() const { return origin; }
 Vector3 Ray::getDirection() const { return direction; }
+float Ray::getConeWidth() const { return coneWidth; }
+float Ray::getConeSpread() const { return coneSpread; }
 
@@ -6,15 +6,26 @@ class Ray {
 	private:
 		Vector3 origin;
 		Vector3 direction;
+		// Ray cone (texture filtering): width of the pixel's footprint at the origin and its growth
+		// per unit of distance, so the footprint at a hit is width + t * spread
+		float coneWidth = 0.0f;
+		float coneSpread = 0.0f;
 	public:
 		Ray(Vector3 origin, Vector3 direction);
+		Ray(Vector3 origin, Vector3 direction, float coneWidth, float coneSpread);
 		~Ray(); // destructor
 
 		Vector3 pointAtParameter(float t) const; // Returns a point along the ray.
+		float coneWidthAt(float t) const;	// footprint width at distance t
+		// Secondary ray leaving this one's hit at distance t: the cone keeps its spread, starting at
+		// the footprint width of the hit (the surface is treated as locally flat)
+		Ray continuation(Vector3 origin, Vector3 direction, float t) const;
 
 		//getters
 		Vector3 getOrigin() const;
 		Vector3 getDirection() const;
+		float getConeWidth() const;
+		float getConeSpread() const;
 };
 
 
@@ -1,113 +1,432 @@
 #include "Raytracer.h"
 #include <omp.h>
-#include <stack>  // Include this at the top of your file
+#include "Random.h"
+#include <thread>
+#include "Arena.h"
+#include "ToneMap.h"
+#include "MappedFile.h"
+#include "SceneFile.h"
+#include "SceneStream.h"
+#include <cstring>
+#include <filesystem>
+
+namespace {
+	thread_local PathQueue pathQueue;	// traceIterative's rays for the pixel this thread is tracing
+
+	// A refracted subtree handed to the scheduler, with everything needed to trace it
+	struct RefractionJob {
+		Ray ray;
+		int depth;
+		MediumStack media;
+		float transmission;
+		Color color;	// result, read once the task group is done
+	};
+}
 
 Raytracer::Raytracer() {}
 
+void Raytracer::setTaskScheduler(std::shared_ptr<TaskScheduler> _scheduler) { scheduler = _scheduler; }
+void Raytracer::setTileSize(int _tileSize) { tileSize = std::max(1, _tileSize); }
+void Raytracer::setTileOrder(TileOrder _tileOrder) { tileOrder = _tileOrder; }
+void Raytracer::setIntegrator(Integrator _integrator) { integrator = _integrator; }
+void Raytracer::setFramebufferFormat(PixelFormat _format) { framebufferFormat = _format; }
+void Raytracer::setTextureFilter(TextureFilter _filter) { textureFilter = _filter; }
+void Raytracer::setTextureLayout(TextureLayout _layout) { textureLayout = _layout; }
+void Raytracer::setTextureCache(std::shared_ptr<TextureCache> _cache) { textureCache = _cache; }
+void Raytracer::setJSONStreaming(bool _stream) { streamJSON = _stream; }
+const ShapePool* Raytracer::getShapePool() const { return shapePool.get(); }
+
+float Raytracer::getExposure() const { return camera->getExposure(); }
+
+void Raytracer::setNumaMode(NumaMode _numaMode) {
+	numaMode = _numaMode;
+	sceneReplicas.clear();
+	if (numaMode != NumaMode::Replicate) return;
+
+	// Build each node's copy on a thread pinned to that node so its pages are allocated there
+	sceneReplicas.resize(topology.getNumNodes());
+	std::vector<std::thread> builders;
+	for (int node = 0; node < topology.getNumNodes(); ++node) {
+		builders.emplace_back([this, node] {
+			topology.pinCurrentThread(node);	// thread index == node: nodeForThread deals round-robin
+			sceneReplicas[node] = std::make_shared<const Scene>(scene.replicate());
+		});
+	}
+	for (std::thread& builder : builders) {
+		builder.join();
+	}
+}
+
+const Scene& Raytracer::sceneForThread() const {
+	if (sceneReplicas.empty()) return scene;
+	return *sceneReplicas[NumaTopology::currentNode()];
+}
+
+bool Raytracer::usesScheduler() const {
+	// Static tile ownership renders on pinned OpenMP threads outside the pool: as scheduler callers they
+	// would all act as worker 0, and pool workers would steal their ray subtrees across nodes
+	return scheduler && numaMode != NumaMode::FirstTouch && numaMode != NumaMode::Replicate;
+}
+
+Image Raytracer::createImage() const {
+	int width = camera->getWidth();
+	int height = camera->getHeight();
+	if (numaMode != NumaMode::FirstTouch && numaMode != NumaMode::Replicate) {
+		return Image(width, height, true, framebufferFormat);
+	}
+
+	// Same tiles and the same static thread assignment as render(): the owner touches first
+	Image image(width, height, false, framebufferFormat);
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	forEachTile(TraversalOrder(tilesX, tilesY, tileOrder), [&](int tile, int) {
+		int x0 = (tile % tilesX) * tileSize;
+		int y0 = (tile / tilesX) * tileSize;
+		for (int y = y0; y < std::min(y0 + tileSize, height); ++y) {
+			for (int x = x0; x < std::min(x0 + tileSize, width); ++x) {
+				image.setPixelColor(x, y, Color());
+			}
+		}
+	});
+	return image;
+}
+
+
+Image Raytracer::createMappedImage(const std::string& filename) const {
+	return Image::mapPPM(filename, camera->getWidth(), camera->getHeight());
+}
+
+
+void TileTimeHistogram::add(double seconds) {
+	min = count == 0 ? seconds : std::min(min, seconds);
+	max = count == 0 ? seconds : std::max(max, seconds);
+	++count;
+	sum += seconds;
+	int bucket = seconds > 1e-6 ? static_cast<int>(std::log2(seconds * 1e6) * bucketsPerDoubling) : 0;
+	++buckets[std::min(bucket, numBuckets - 1)];
+}
+
+void TileTimeHistogram::merge(const TileTimeHistogram& other) {
+	if (other.count == 0) return;
+	min = count == 0 ? other.min : std::min(min, other.min);
+	max = count == 0 ? other.max : std::max(max, other.max);
+	count += other.count;
+	sum += other.sum;
+	for (int i = 0; i < numBuckets; ++i) buckets[i] += other.buckets[i];
+}
+
+double TileTimeHistogram::percentile(double p) const {
+	if (count == 0) return 0.0;
+	long long rank = static_cast<long long>(p * static_cast<double>(count - 1));
+	if (rank <= 0) return min;
+	if (rank >= count - 1) return max;
+	long long seen = 0;
+	int bucket = 0;
+	while ((seen += buckets[bucket]) <= rank) ++bucket;
+	// upper edge of the bucket holding the tile of that rank
+	double upper = 1e-6 * std::exp2(static_cast<double>(bucket + 1) / bucketsPerDoubling);
+	return std::min(std::max(upper, min), max);
+}
+
 
-void Raytracer::render(Image& image) {
+RenderStats Raytracer::render(Image& image, Image* radiance, const RowsCallback& onRowsFinished) const {
 	int width = image.getWidth();
 	int height = image.getHeight();
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	int numThreads = usesScheduler() ? scheduler->getNumThreads() : omp_get_max_threads();
+	TraversalOrder tileSequence(tilesX, tilesY, tileOrder);
+	std::vector<int> pixelOrder = makeTraversalOrder(tileSize, tileSize, tileOrder);
+
+	RenderStats stats;
+	std::vector<TileTimeHistogram> threadTileTimes(numThreads);	// merged after the frame, no atomics per tile
+	stats.threadFinishTimes.assign(numThreads, 0.0);
+	std::atomic<long long> allocations{0};
+	std::atomic<long long> textureHits{0}, textureMisses{0};
+	// Count finished tiles per tile row so whole bands can be streamed out, or written back and evicted
+	// from a mapped framebuffer
+	std::unique_ptr<std::atomic<int>[]> finishedTiles;
+	if (image.isMapped() || onRowsFinished) {
+		finishedTiles.reset(new std::atomic<int>[tilesY]);
+		for (int row = 0; row < tilesY; ++row) finishedTiles[row] = 0;
+	}
+	double frameStart = omp_get_wtime();
+
+	forEachTile(tileSequence, [&](int tile, int thread) {
+		long long allocationsBefore = AllocationCounter::threadAllocations();
+		long long hitsBefore = TextureCache::threadHits(), missesBefore = TextureCache::threadMisses();
+		double tileStart = omp_get_wtime();
+		int x0 = (tile % tilesX) * tileSize;
+		int y0 = (tile / tilesX) * tileSize;
+		renderTile(image, radiance, x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height), pixelOrder);
+
+		double tileEnd = omp_get_wtime();
+		threadTileTimes[thread].add(tileEnd - tileStart);
+		stats.threadFinishTimes[thread] = std::max(stats.threadFinishTimes[thread], tileEnd - frameStart);
+		allocations += AllocationCounter::threadAllocations() - allocationsBefore;
+		textureHits += TextureCache::threadHits() - hitsBefore;
+		textureMisses += TextureCache::threadMisses() - missesBefore;
+
+		if (finishedTiles && ++finishedTiles[tile / tilesX] == tilesX) {
+			image.finishRows(y0, std::min(y0 + tileSize, height));
+			if (onRowsFinished) onRowsFinished(y0, std::min(y0 + tileSize, height));
+		}
+	});
+
+	stats.totalTime = omp_get_wtime() - frameStart;
+	for (const TileTimeHistogram& times : threadTileTimes) stats.tileTimes.merge(times);
+	stats.allocations = allocations;
+	stats.textureHits = textureHits;
+	stats.textureMisses = textureMisses;
+	return stats;
+}
+
+
+int Raytracer::renderProgressive(Image& image, const ProgressiveSettings& settings, const PassCallback& onPass) const {
+	int width = image.getWidth();
+	int height = image.getHeight();
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	TraversalOrder tileSequence(tilesX, tilesY, tileOrder);
+	std::vector<int> pixelOrder = makeTraversalOrder(tileSize, tileSize, tileOrder);
+	int block = std::max(1, settings.coarseBlock);
+
+	double deadline = settings.timeBudget > 0.0 ? omp_get_wtime() + settings.timeBudget : INFINITY;
+
+	// Pass 0: one ray per block, splatted over the whole block. Always completes so there is an image.
+	forEachTile(tileSequence, [&](int tile, int) {
+		int x0 = (tile % tilesX) * tileSize;
+		int y0 = (tile / tilesX) * tileSize;
+		int x1 = std::min(x0 + tileSize, width);
+		int y1 = std::min(y0 + tileSize, height);
+		for (int by = y0; by < y1; by += block) {
+			for (int bx = x0; bx < x1; bx += block) {
+				int bw = std::min(block, x1 - bx);
+				int bh = std::min(block, y1 - by);
+				Color color = toneMap(tracePixel(bx + 0.5f * bw, by + 0.5f * bh, width, height));
+				for (int y = by; y < by + bh; ++y) {
+					for (int x = bx; x < bx + bw; ++x) {
+						image.setPixelColor(x, y, color);
+					}
+				}
+			}
+		}
+	});
+	if (onPass) onPass(image, 0, 0);
+
+	// Refinement: each pass adds one sample to every pixel of a tile and rewrites the tile's average.
+	// Tiles are all-or-nothing, so after the deadline the image mixes at most two sample counts.
+	// A pixel's samples are always summed by one thread in sample order, so with a sample target
+	// (and no deadline) the result is bit-identical for any thread count or schedule.
+	std::vector<Color> accumulation(static_cast<size_t>(width) * height);
+	std::vector<int> tileSamples(static_cast<size_t>(tilesX) * tilesY, 0);
+	int samples = 0;
+
+	for (int pass = 1; samples < settings.maxSamples && omp_get_wtime() < deadline; ++pass) {
+		forEachTile(tileSequence, [&](int tile, int) {
+			if (omp_get_wtime() >= deadline) return;
+
+			int sample = tileSamples[tile];
+			int x0 = (tile % tilesX) * tileSize;
+			int y0 = (tile / tilesX) * tileSize;
+
+			for (int offset : pixelOrder) {
+				int x = x0 + offset % tileSize;
+				int y = y0 + offset / tileSize;
+				if (x >= width || y >= height) continue;
+
+				// the first sample goes through the pixel center, like render()
+				SampleRandom random(static_cast<uint64_t>(y) * width + x, sample, 0, settings.seed);
+				float dx = sample == 0 ? 0.5f : random.uniform(0);
+				float dy = sample == 0 ? 0.5f : random.uniform(1);
+				Color& sum = accumulation[static_cast<size_t>(y) * width + x];
+				sum += tracePixel(x + dx, y + dy, width, height);
+				image.setPixelColor(x, y, toneMap(sum * (1.0f / static_cast<float>(sample + 1))));
+			}
+			tileSamples[tile] = sample + 1;
+		});
 
-	//#pragma omp parallel for
-	for (int y = 0; y < height; ++y) {		//bottom to top
-		for (int x = 0; x < width; ++x) {	//left to right
-			//Normalized pixel coordinates
-			float u = 1.0f - (static_cast<float>(x) + 0.5f) / static_cast<float>(width);	//(subtracting from 1 because before it was flipped)
-			float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(height);
-			v = 1.0f - v; // Flip v if necessary
-
-			Ray ray = camera->generateRay(u, v);
-			std::stack<float> refractiveStack;
-			Color color = traceRay(ray, 0, refractiveStack);
-			// Apply linear tone mapping
-			color = color * camera->getExposure(); //TODO: What if exposure is too low
-			float maxIntensity = std::max(color.getR(), std::max(color.getG(), color.getB()));
-			if (maxIntensity > 1.0f) {
-				color = color.linearToneMap(maxIntensity);
+		samples = *std::min_element(tileSamples.begin(), tileSamples.end());
+		if (onPass) onPass(image, pass, samples);
+	}
+	return samples;
+}
+
+
+void Raytracer::forEachTile(const TraversalOrder& tileSequence, const std::function<void(int tile, int thread)>& runTile) const {
+	bool pin = numaMode != NumaMode::None;
+	bool staticOwnership = numaMode == NumaMode::FirstTouch || numaMode == NumaMode::Replicate;
+	// Positions in the order, not tiles: curve positions outside the frame are skipped
+	long long numPositions = static_cast<long long>(tileSequence.size());
+
+	if (staticOwnership) {
+		// A tile always goes to the same thread (and node), so it renders into memory local to it.
+		// This bypasses the work-stealing scheduler, which would move tiles between nodes, and traceRay
+		// does not split rays into its tasks either (see usesScheduler()).
+		// Fixed chunks dealt round-robin: the skipped positions cluster on the curve, so one contiguous
+		// range per thread could leave some threads with hardly any tiles
+		#pragma omp parallel
+		{
+			ScopedPin threadPin(topology, omp_get_thread_num());
+			#pragma omp for schedule(static, 64)
+			for (long long i = 0; i < numPositions; ++i) {
+				int tile = tileSequence.cellAt(static_cast<uint64_t>(i));
+				if (tile < 0) continue;
+				ArenaScope tileScope(Arena::forThread());
+				runTile(tile, omp_get_thread_num());
+			}
+		}
+	} else if (scheduler) {
+		// Idle workers steal tiles and, inside heavy tiles, secondary rays. Tiles are spawned as ranges
+		// split in halves, so the deques hold a few ranges instead of one task per tile. A range is a
+		// power-of-two run of positions, packed with the log2 of its length into one word: the closure
+		// stays two words and fits std::function's inline buffer
+		ScopedPin callerPin(topology, 0, pin);	// the calling thread is worker 0
+		TaskGroup frame;
+		std::function<void(uint64_t)> runRange = [&](uint64_t range) {
+			uint64_t begin = range >> 6;
+			for (uint64_t logLength = range & 63; logLength > 0; --logLength) {
+				uint64_t middle = begin + (uint64_t(1) << (logLength - 1));
+				if (middle >= static_cast<uint64_t>(numPositions)) continue;
+				uint64_t upperHalf = middle << 6 | (logLength - 1);
+				scheduler->spawn(frame, [&runRange, upperHalf] { runRange(upperHalf); });
 			}
-			image.setPixelColor(x, y, color);
+			int tile = tileSequence.cellAt(begin);
+			if (tile < 0) return;
+			ArenaScope tileScope(Arena::forThread());
+			runTile(tile, TaskScheduler::currentWorker());
+		};
+		if (numPositions > 0) {
+			uint64_t logLength = 0;
+			while ((uint64_t(1) << logLength) < static_cast<uint64_t>(numPositions)) ++logLength;
+			scheduler->spawn(frame, [&runRange, logLength] { runRange(logLength); });
 		}
+		scheduler->wait(frame);
+	} else {
+		// Tiles differ a lot in cost (reflective/refractive hits), so hand them out dynamically
+		#pragma omp parallel
+		{
+			ScopedPin threadPin(topology, omp_get_thread_num(), pin);
+			#pragma omp for schedule(dynamic)
+			for (long long i = 0; i < numPositions; ++i) {
+				int tile = tileSequence.cellAt(static_cast<uint64_t>(i));
+				if (tile < 0) continue;
+				ArenaScope tileScope(Arena::forThread());
+				runTile(tile, omp_get_thread_num());
+			}
+		}
+	}
+}
+
+
+void Raytracer::renderTile(Image& image, Image* radiance, int x0, int y0, int x1, int y1, const std::vector<int>& pixelOrder) const {
+	int width = image.getWidth();
+	int height = image.getHeight();
+
+	for (int offset : pixelOrder) {
+		int x = x0 + offset % tileSize;
+		int y = y0 + offset / tileSize;
+		if (x >= x1 || y >= y1) continue;	// partial tile at the right/top edge
+
+		Color color = tracePixel(static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f, width, height);
+		if (radiance) radiance->setPixelColor(x, y, color);
+		image.setPixelColor(x, y, toneMap(color));
 	}
 }
 
 
+Color Raytracer::tracePixel(float px, float py, int width, int height) const {
+	//Normalized pixel coordinates
+	float u = 1.0f - px / static_cast<float>(width);	//(subtracting from 1 because before it was flipped)
+	float v = py / static_cast<float>(height);
+	v = 1.0f - v; // Flip v if necessary
+
+	Ray ray = camera->generateRay(u, v);
+	if (integrator == Integrator::Iterative) {
+		return traceIterative(ray);
+	}
+	MediumStack media;
+	return traceRay(ray, 0, media);
+}
+
+
+Color Raytracer::toneMap(Color radiance) const {
+	// Apply linear tone mapping
+	return toneMapLinear(radiance, camera->getExposure());
+}
+
+
 
-Color Raytracer::traceRay(const Ray& ray, int depth, std::stack<float> refractiveStack) {
+Color Raytracer::traceRay(const Ray& ray, int depth, MediumStack& media) const {
 	// Base case: Limit the number of bounces
 	if (depth > nbounces) {
 		return Color(0.0f, 0.0f, 0.0f);  // Black color for exceeded recursion
 	}
 
+	const Scene& scene = sceneForThread();
 	float t;  // Distance to the closest intersection
-	std::shared_ptr<Shape> hitObject = scene.intersect(ray, t, false, 0.0f, nullptr);
+	const Shape* hitObject = scene.intersect(ray, t, false, 0.0f, nullptr);
 	Color localColor;
 
 	// Intersection detected
 	if (hitObject != nullptr) {
-		if (rendermode == "binary") {
+		if (renderMode == RenderMode::Binary) {
 			return Color(1.0f, 0.0f, 0.0f);  // Red color
-		} else if (rendermode == "phong") {
+		} else if (renderMode == RenderMode::Phong) {
 			// Retrieve material and intersection details
-			Material material = hitObject->getMaterial();
+			const Material& material = hitObject->getMaterial();
 			Vector3 intersectionPoint = ray.pointAtParameter(t);
 			Vector3 normal = hitObject->getNormal(intersectionPoint);
 
-			// Local shading using Blinn-Phong
-			localColor = shadeBlinnPhong(ray, t, hitObject);
-
-			// Apply texture if available
-			if (material.hasTextureMap()) {
-				std::cout << "Texture mapping" << std::endl;
-				Color textureColor = hitObject->getTextureColor(intersectionPoint, material.getTexture());
-				localColor = localColor * (1.0f - material.getKd()) + textureColor * material.getKd();
-			}
+			// Local shading using Blinn-Phong (and texture)
+			localColor = shadeSurface(ray, t, hitObject);
 
 			// **Refraction Logic**: Only process if the material is refractive
 			Color refractionColor(0.0f, 0.0f, 0.0f);  // Initialize refraction contribution
-			if (material.getIsRefractive() && depth < nbounces) {
-				Vector3 viewDir = ray.getDirection().normalize() * -1.0f;  // View direction
-				bool entering = dotProduct(viewDir, normal) > 0;  // Determine if entering or exiting
-				Vector3 adjustedNormal = entering ? normal : normal * -1.0f;
-
-				// Compute refractive indices
-				float n1 = refractiveStack.empty() ? 1.0f : refractiveStack.top();
-				float n2 = entering ? material.getRefractiveIndex() : (refractiveStack.size() > 1 ? refractiveStack.top() : 1.0f);
-				/*float n1 = entering ? 1.0f : material.getRefractiveIndex();
-				float n2 = entering ? material.getRefractiveIndex() : 1.0f;*/
-				float eta = n1 / n2;
-
-				// Compute the cosine of the incident angle
-				float cosTheta1 = -dotProduct(ray.getDirection(), adjustedNormal);
-				float sin2Theta2 = eta * eta * (1.0f - cosTheta1 * cosTheta1);
-
-				if (sin2Theta2 <= 1.0f) {  // No total internal reflection
-					float cosTheta2 = sqrt(1.0f - sin2Theta2);
-					Vector3 refractDir = ray.getDirection() * eta + adjustedNormal * (eta * cosTheta1 - cosTheta2);
-					refractDir = refractDir.normalize();
-
-					// Update stack
-					if (entering) {
-						refractiveStack.push(material.getRefractiveIndex());
-					} else if (!refractiveStack.empty()) {
-						refractiveStack.pop();
-						//refractiveStack.push(material.getRefractiveIndex());
-					}
+			TaskGroup refractionTask;	// used when the refracted ray is traced as a stealable task
+			RefractionJob* refractionJob = nullptr;
+			Arena::Mark arenaStart{};
+			Vector3 refractOrigin, refractDir;
+			bool entering;
+			if (material.getIsRefractive() && depth < nbounces &&
+				refract(ray, intersectionPoint, normal, material, media, refractOrigin, refractDir, entering)) {
+				// Update stack (undone below once the refracted subtree is traced)
+				Medium exited;
+				bool changed = updateMedia(media, entering, material, exited);
+
+				float transmission = 1.0f - material.getReflectivity();
+				if (usesScheduler() && depth < splitDepth && material.getIsReflective()) {
+					// The ray tree branches here: let an idle thread take the refracted subtree
+					// (the task gets its own copy of the media, this thread goes on with the reflection).
+					// The job lives in this thread's arena so the task closure is two pointers and
+					// fits std::function's inline buffer: spawning does not touch the heap.
+					Arena& arena = Arena::forThread();
+					arenaStart = arena.mark();
+					refractionJob = arena.create<RefractionJob>(RefractionJob{ray.continuation(refractOrigin, refractDir, t), depth + 1, media, transmission, Color()});
+					scheduler->spawn(refractionTask, [this, refractionJob] {
+						refractionJob->color = traceRay(refractionJob->ray, refractionJob->depth, refractionJob->media) *
+											   refractionJob->transmission;
+					});
+				} else {
+					refractionColor = traceRay(ray.continuation(refractOrigin, refractDir, t), depth + 1, media) * transmission;
+				}
 
-					// Offset slightly to avoid self-intersection
-					Ray refractRay(intersectionPoint - adjustedNormal * 1e-4, refractDir);
-					refractionColor = traceRay(refractRay, depth + 1, refractiveStack) * (1.0f - material.getReflectivity());
+				// The reflected ray stays in the medium the incident ray came through
+				if (changed) {
+					restoreMedia(media, entering, exited);
 				}
-				if (hitObject->toString() == "Cylinder") std::cout << "Depth " << depth << " n1: " << n1 << " n2: " << n2 << " Color " << refractionColor.toString() << std::endl;
 			}
 
 			// **Reflection Logic**: Keep existing reflection code intact
 			if (material.getIsReflective() && depth < nbounces) {
-				Vector3 reflectDir = ray.getDirection() - normal * 2.0f * dotProduct(ray.getDirection(), normal);
-				reflectDir = reflectDir.normalize();
-
-				Ray reflectRay(intersectionPoint + normal * 1e-4, reflectDir);  // Offset to avoid self-intersection
-				Color reflectionColor = traceRay(reflectRay, depth + 1, refractiveStack);
+				Color reflectionColor = traceRay(reflect(ray, t, intersectionPoint, normal), depth + 1, media);
+				if (refractionJob) {
+					if (!refractionTask.done()) {
+						scheduler->wait(refractionTask);
+					}
+					refractionColor = refractionJob->color;
+					Arena::forThread().rewind(arenaStart);	// anything allocated after the job is already released
+				}
 
 				// Combine local, reflected, and refracted colors
 				localColor = localColor * (1.0f - material.getReflectivity()) +
@@ -118,34 +437,158 @@ Color Raytracer::traceRay(const Ray& ray, int depth, std::stack<float> refractiv
 				localColor += refractionColor;
 			}
 
-			if (hitObject->toString() != "Cylinder") std::cout << "Depth " << depth << " hitting : " << hitObject->toString() << " Color " << localColor.toString() << std::endl;
 			return localColor;
 		}
 	}
 
+	return missColor();
+}
+
+
+Color Raytracer::traceIterative(const Ray& primaryRay) const {
+	// Depth-first over the ray tree: the queue only ever holds the siblings still to be traced
+	PathQueue& queue = pathQueue;
+	queue.clear();
+	queue.push(PathState{primaryRay, 0, 1.0f, MediumStack()});
+
+	const Scene& scene = sceneForThread();
+	Color radiance(0.0f, 0.0f, 0.0f);
+	while (!queue.empty()) {
+		const PathState state = queue.pop();
+
+		float t;
+		const Shape* hitObject = scene.intersect(state.ray, t, false, 0.0f, nullptr);
+		if (hitObject == nullptr) {
+			radiance += missColor() * state.weight;
+			continue;
+		}
+		if (renderMode != RenderMode::Phong) {
+			radiance += (renderMode == RenderMode::Binary ? Color(1.0f, 0.0f, 0.0f) : missColor()) * state.weight;
+			continue;
+		}
+
+		const Material& material = hitObject->getMaterial();
+		Vector3 intersectionPoint = state.ray.pointAtParameter(t);
+		Vector3 normal = hitObject->getNormal(intersectionPoint);
+		Color localColor = shadeSurface(state.ray, t, hitObject);
+		bool reflects = material.getIsReflective() && state.depth < nbounces;
+
+		// Same weights as the recursive combination: local*(1-r) + reflected*r + refracted*(1-r)
+		Vector3 refractOrigin, refractDir;
+		bool entering;
+		if (material.getIsRefractive() && state.depth < nbounces &&
+			refract(state.ray, intersectionPoint, normal, material, state.media, refractOrigin, refractDir, entering)) {
+			PathState refracted{state.ray.continuation(refractOrigin, refractDir, t), state.depth + 1,
+								state.weight * (1.0f - material.getReflectivity()), state.media};
+			Medium exited;
+			updateMedia(refracted.media, entering, material, exited);
+			queue.push(refracted);
+		}
+		if (reflects) {
+			radiance += localColor * ((1.0f - material.getReflectivity()) * state.weight);
+			queue.push(PathState{reflect(state.ray, t, intersectionPoint, normal), state.depth + 1,
+								 state.weight * material.getReflectivity(), state.media});
+		} else {
+			radiance += localColor * state.weight;
+		}
+	}
+	return radiance;
+}
+
+
+Color Raytracer::missColor() const {
 	// No intersection
-	if (rendermode == "binary") {
+	if (renderMode == RenderMode::Binary) {
 		// No intersection: return black for background
 		return Color(0.0f, 0.0f, 0.0f);  // Black color
-	} else if (rendermode == "phong") {
-		// No intersection: return background color
-		return scene.getBackgroundColor();
 	}
+	// No intersection: return background color
+	return sceneForThread().getBackgroundColor();
 }
 
 
-Color Raytracer::shadeBlinnPhong(const Ray& ray, float& t, std::shared_ptr<Shape> hitObject) {
-	//std::cout << "Blinn Phong" << std::endl;
-	Material material;
-	Vector3 intersectionPoint;
-	Vector3 n_normal;  // Normal at intersection
-	
-	//#pragma omp critical
-	//{
-		material = hitObject->getMaterial();
-		intersectionPoint = ray.pointAtParameter(t);
-		n_normal = hitObject->getNormal(intersectionPoint);  // Normal at intersection
-	//}
+Color Raytracer::shadeSurface(const Ray& ray, float t, const Shape* hitObject) const {
+	const Material& material = hitObject->getMaterial();
+	Color localColor = shadeBlinnPhong(ray, t, hitObject);
+
+	// Apply texture if available
+	if (material.hasTextureMap()) {
+		Vector3 intersectionPoint = ray.pointAtParameter(t);
+		float footprint = 0.0f;
+		if (textureFilter == TextureFilter::Trilinear) {
+			// The cone's cross-section, stretched over a surface seen at a grazing angle
+			float cosine = std::fabs(dotProduct(hitObject->getNormal(intersectionPoint), ray.getDirection().normalize()));
+			footprint = ray.coneWidthAt(t) / std::max(cosine, 0.05f);
+		}
+		Color textureColor = hitObject->getTextureColor(intersectionPoint, material.getTexture(), footprint);
+		localColor = localColor * (1.0f - material.getKd()) + textureColor * material.getKd();
+	}
+	return localColor;
+}
+
+
+bool Raytracer::refract(const Ray& ray, const Vector3& intersectionPoint, const Vector3& normal, const Material& material,
+						const MediumStack& media, Vector3& origin, Vector3& direction, bool& entering) const {
+	Vector3 viewDir = ray.getDirection().normalize() * -1.0f;  // View direction
+	entering = dotProduct(viewDir, normal) > 0;  // Determine if entering or exiting
+	Vector3 adjustedNormal = entering ? normal : normal * -1.0f;
+
+	// Compute refractive indices
+	float n1 = media.empty() ? 1.0f : media.top().refractiveIndex;
+	float n2 = entering ? material.getRefractiveIndex() : (media.size() > 1 ? media.top().refractiveIndex : 1.0f);
+	float eta = n1 / n2;
+
+	// Compute the cosine of the incident angle
+	float cosTheta1 = -dotProduct(ray.getDirection(), adjustedNormal);
+	float sin2Theta2 = eta * eta * (1.0f - cosTheta1 * cosTheta1);
+	if (sin2Theta2 > 1.0f) {
+		return false;  // Total internal reflection
+	}
+
+	float cosTheta2 = sqrt(1.0f - sin2Theta2);
+	direction = ray.getDirection() * eta + adjustedNormal * (eta * cosTheta1 - cosTheta2);
+	direction = direction.normalize();
+	origin = intersectionPoint - adjustedNormal * 1e-4;	// Offset slightly to avoid self-intersection
+	return true;
+}
+
+
+Ray Raytracer::reflect(const Ray& ray, float t, const Vector3& intersectionPoint, const Vector3& normal) const {
+	Vector3 reflectDir = ray.getDirection() - normal * 2.0f * dotProduct(ray.getDirection(), normal);
+	reflectDir = reflectDir.normalize();
+	return ray.continuation(intersectionPoint + normal * 1e-4, reflectDir, t);  // Offset to avoid self-intersection
+}
+
+
+bool Raytracer::updateMedia(MediumStack& media, bool entering, const Material& material, Medium& exited) {
+	if (entering) {
+		media.push(Medium{material.getRefractiveIndex(), Color()});
+		return true;
+	}
+	if (!media.empty()) {
+		exited = media.top();
+		media.pop();
+		return true;
+	}
+	return false;
+}
+
+
+void Raytracer::restoreMedia(MediumStack& media, bool entering, const Medium& exited) {
+	if (entering) {
+		media.pop();
+	} else {
+		media.push(exited);
+	}
+}
+
+
+Color Raytracer::shadeBlinnPhong(const Ray& ray, float t, const Shape* hitObject) const {
+	// Shapes are immutable while rendering, so no locking is needed here
+	const Scene& scene = sceneForThread();
+	const Material& material = hitObject->getMaterial();
+	Vector3 intersectionPoint = ray.pointAtParameter(t);
+	Vector3 n_normal = hitObject->getNormal(intersectionPoint);  // Normal at intersection
 	Vector3 v_viewDir = (ray.getOrigin() - intersectionPoint).normalize();
 
 
@@ -181,21 +624,119 @@ Color Raytracer::shadeBlinnPhong(const Ray& ray, float& t, std::shared_ptr<Shape
 }
 
 
-Image Raytracer::readJSON(const std::string& filename) {
+std::shared_ptr<const Texture> Raytracer::loadTexture(const std::string& path, ColorSpace colorSpace, AssetCache* cache) const {
+	if (textureCache) {
+		return textureCache->getTexture(path, colorSpace);
+	}
+	if (cache) {
+		return cache->getTexture(path, colorSpace, textureLayout);
+	}
+	return std::make_shared<const Texture>(path, colorSpace, textureLayout);
+}
+
+Image Raytracer::readJSON(const std::string& filename, AssetCache* cache) {
+	loadJSON(filename, cache);
+	return Image(camera->getWidth(), camera->getHeight());
+}
+
+void Raytracer::loadJSON(const std::string& filename, AssetCache* cache) {
+	if (streamJSON) {
+		loadJSONStreaming(filename, cache);
+		return;
+	}
 	std::ifstream file(filename);
 	if (!file) {
 		throw std::runtime_error("Could not open JSON file: " + filename);
 	}
 
 	nlohmann::json j = nlohmann::json::parse(file);
+	loadSettings(j, filename);
 
+	auto& sceneData = j["scene"];
+	if (sceneData.contains("lightsources")) {
+		// Load lights
+		for (const auto& lightData : sceneData["lightsources"]) {
+			addLight(lightData);
+		}
+	}
+
+	// Load shapes (or reuse them from a scene with the very same shapes array)
+	std::string geometryKey = cache ? sceneData["shapes"].dump() : std::string();
+	std::vector<std::shared_ptr<Shape>> shapes;
+	if (cache && cache->findGeometry(geometryKey, shapes)) {
+		shapePool = nullptr;	// the shapes live in the pool of the scene that built them
+		for (const std::shared_ptr<Shape>& shape : shapes) {
+			scene.addShape(shape);
+		}
+		return;
+	}
+
+	// Reserve every shape first so each type ends up in one contiguous run of the pool
+	shapePool = ShapePool::create();
+	for (const auto& shapeData : sceneData["shapes"]) {
+		reserveShape(*shapePool, shapeData);
+	}
+	shapePool->allocate();
+
+	for (const auto& shapeData : sceneData["shapes"]) {
+		if (std::shared_ptr<Shape> shape = createShape(shapeData, cache)) {
+			shapes.push_back(shape);
+		}
+	}
+
+	for (const std::shared_ptr<Shape>& shape : shapes) {
+		scene.addShape(shape);
+	}
+	if (cache) {
+		cache->storeGeometry(geometryKey, shapes);
+	}
+}
+
+void Raytracer::loadJSONStreaming(const std::string& filename, AssetCache* cache) {
+	std::unique_ptr<MappedFile> file;
+	try {
+		file = std::make_unique<MappedFile>(filename);
+	} catch (const std::runtime_error&) {
+		throw std::runtime_error("Could not open JSON file: " + filename);
+	}
+	const uint8_t* begin = file->data();
+	const uint8_t* end = begin + file->size();
+
+	// The pool must know every shape before the first is created: a first pass only counts them
+	shapePool = ShapePool::create();
+	parseSceneStreaming(begin, end, [this](const std::string& array, const nlohmann::json& element) {
+		if (array == "shapes") reserveShape(*shapePool, element);
+	}, filename);
+	shapePool->allocate();
+
+	// Second pass: lights and shapes are built as their elements end, settings from what is left
+	std::vector<std::shared_ptr<Shape>> shapes;
+	nlohmann::json j = parseSceneStreaming(begin, end, [&](const std::string& array, const nlohmann::json& element) {
+		if (array == "lightsources") {
+			addLight(element);
+		} else if (std::shared_ptr<Shape> shape = createShape(element, cache)) {
+			shapes.push_back(shape);
+		}
+	}, filename);
+	loadSettings(j, filename);
+
+	for (const std::shared_ptr<Shape>& shape : shapes) {
+		scene.addShape(shape);
+	}
+}
+
+void Raytracer::loadSettings(const nlohmann::json& j, const std::string& filename) {
 	// Load raytracer settings
 	if (j.contains("nbounces")) {
 		nbounces = j["nbounces"];
 	} else {
 		nbounces = 1;
 	}
+	if (nbounces > MAX_BOUNCES) {
+		throw std::runtime_error("nbounces is limited to " + std::to_string(MAX_BOUNCES) + ": " + filename);
+	}
 	rendermode = j["rendermode"];
+	renderMode = rendermode == "binary" ? RenderMode::Binary : rendermode == "phong" ? RenderMode::Phong : RenderMode::Other;
 
 	// Load camera
 	auto camData = j["camera"];
@@ -220,73 +761,212 @@ Image Raytracer::readJSON(const std::string& filename) {
 			sceneData["backgroundcolor"][2]
 	);
 	scene.setBackgroundColor(backgroundColor);
+}
 
-	if (sceneData.contains("lightsources")) {
-		// Load lights
-		for (const auto& lightData : sceneData["lightsources"]) {
-			if (lightData["type"] == "pointlight") {
-				scene.addLight(std::make_shared<PointLight>(
-						Vector3(lightData["position"][0], lightData["position"][1], lightData["position"][2]),
-						Color(lightData["intensity"][0], lightData["intensity"][1], lightData["intensity"][2])
-				));
-			}
-			std::cout << "Light" << scene.getLights()[0]->getPosition() << std::endl;
+void Raytracer::addLight(const nlohmann::json& lightData) {
+	if (lightData["type"] == "pointlight") {
+		scene.addLight(std::make_shared<PointLight>(
+				Vector3(lightData["position"][0], lightData["position"][1], lightData["position"][2]),
+				Color(lightData["intensity"][0], lightData["intensity"][1], lightData["intensity"][2])
+		));
+	}
+}
+
+void Raytracer::reserveShape(ShapePool& pool, const nlohmann::json& shapeData) {
+	if (shapeData["type"] == "sphere") pool.reserve<Sphere>(1);
+	else if (shapeData["type"] == "cylinder") pool.reserve<Cylinder>(1);
+	else if (shapeData["type"] == "triangle") pool.reserve<Triangle>(1);
+}
+
+std::shared_ptr<Shape> Raytracer::createShape(const nlohmann::json& shapeData, AssetCache* cache) {
+	Material material;
+	if (shapeData.contains("material")) {
+		const auto& materialData = shapeData["material"];
+		material = Material(
+				materialData["ks"],
+				materialData["kd"],
+				materialData["specularexponent"],
+				Color(materialData["diffusecolor"][0], materialData["diffusecolor"][1], materialData["diffusecolor"][2]),
+				Color(materialData["specularcolor"][0], materialData["specularcolor"][1], materialData["specularcolor"][2]),
+				materialData["isreflective"],
+				materialData["reflectivity"],
+				materialData["isrefractive"],
+				materialData["refractiveindex"]
+		);
+		if (materialData.contains("texture")) {
+			// "texturecolorspace": "srgb" decodes 8-bit sRGB textures to linear values
+			ColorSpace colorSpace = parseColorSpace(materialData.value("texturecolorspace", "linear"));
+			material.setTexture(loadTexture(materialData["texture"], colorSpace, cache));
 		}
+
+	} else {
+		material = Material(0.5f, 0.5f, 32, Color(1, 1, 1), Color(1, 1, 1), false, 0.0f, false, 1.0f);
+	}
+	if (shapeData["type"] == "sphere") {
+		return shapePool->create<Sphere>(
+				Vector3(shapeData["center"][0], shapeData["center"][1], shapeData["center"][2]),
+				shapeData["radius"],
+				material
+		);
+	} else if (shapeData["type"] == "cylinder") {
+		return shapePool->create<Cylinder>(
+				Vector3(shapeData["center"][0], shapeData["center"][1], shapeData["center"][2]),
+				Vector3(shapeData["axis"][0], shapeData["axis"][1], shapeData["axis"][2]),
+				shapeData["radius"],
+				shapeData["height"],
+				material
+		);
+	} else if (shapeData["type"] == "triangle") {
+		return shapePool->create<Triangle>(
+				Vector3(shapeData["v0"][0], shapeData["v0"][1], shapeData["v0"][2]),
+				Vector3(shapeData["v1"][0], shapeData["v1"][1], shapeData["v1"][2]),
+				Vector3(shapeData["v2"][0], shapeData["v2"][1], shapeData["v2"][2]),
+				material
+		);
 	}
-	std::cout << "Lights loaded" << std::endl;
+	return nullptr;
+}
 
+void Raytracer::loadScene(const std::string& filename, AssetCache* cache) {
+	if (std::filesystem::path(filename).extension() == SceneFile::extension) {
+		loadCompiled(filename, cache);
+	} else {
+		loadJSON(filename, cache);
+	}
+}
 
-	// Load shapes
-	for (const auto& shapeData : sceneData["shapes"]) {
-		Material material;
-		std::cout << "shape found"<< std::endl;
-		if (shapeData.contains("material")) {
-			std::cout <<"Material found"<< std::endl;
-			auto materialData = shapeData["material"];
-			material = Material(
-					materialData["ks"],
-					materialData["kd"],
-					materialData["specularexponent"],
-					Color(materialData["diffusecolor"][0], materialData["diffusecolor"][1], materialData["diffusecolor"][2]),
-					Color(materialData["specularcolor"][0], materialData["specularcolor"][1], materialData["specularcolor"][2]),
-					materialData["isreflective"],
-					materialData["reflectivity"],
-					materialData["isrefractive"],
-					materialData["refractiveindex"]
-			);
-			if (materialData.contains("texture")) {
-				std::cout <<"Texture found"<< std::endl;
-				Image texture = Image(materialData["texture"]);
-				material.setTexture(texture);
-				std::cout <<"Texture loaded"<< std::endl;
-			}
+void Raytracer::loadCompiled(const std::string& filename, AssetCache* cache) {
+	using namespace SceneFile;
+	MappedFile file(filename);
+	const uint8_t* data = file.data();
+	Header header;
+	if (file.size() < sizeof(Header)) {
+		throw std::runtime_error("Not a compiled scene: " + filename);
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+		throw std::runtime_error("Not a compiled scene: " + filename);
+	}
+	if (header.version != version || header.byteOrder != byteOrderMark) {
+		throw std::runtime_error("Compiled scene of another version or byte order, recompile it: " + filename);
+	}
+	// The header is checked against the mapped length before any array is touched: a truncated or
+	// corrupted file must fail here, not read past the end of the mapping
+	if (header.fileSize != file.size()) {
+		throw std::runtime_error("Truncated or corrupted compiled scene (" + std::to_string(file.size()) + " bytes, header says " +
+								 std::to_string(header.fileSize) + "): " + filename);
+	}
+	if (static_cast<uint64_t>(header.numSpheres) + header.numCylinders + header.numTriangles != header.numShapes) {
+		throw std::runtime_error("Corrupt compiled scene (shape counts disagree): " + filename);
+	}
+	auto array = [&](uint64_t offset, uint64_t count, size_t recordSize) {
+		if (offset % 8 != 0 || offset < sizeof(Header) || offset > file.size() || count > (file.size() - offset) / recordSize) {
+			throw std::runtime_error("Corrupt compiled scene (array outside the file): " + filename);
+		}
+		return data + offset;
+	};
+	const auto* strings = reinterpret_cast<const StringRecord*>(array(header.strings, header.numStrings, sizeof(StringRecord)));
+	const auto* lights = reinterpret_cast<const LightRecord*>(array(header.lights, header.numLights, sizeof(LightRecord)));
+	const auto* materials = reinterpret_cast<const MaterialRecord*>(array(header.materials, header.numMaterials, sizeof(MaterialRecord)));
+	const auto* shapeRecords = reinterpret_cast<const ShapeRecord*>(array(header.shapes, header.numShapes, sizeof(ShapeRecord)));
+	const auto* spheres = reinterpret_cast<const SphereRecord*>(array(header.spheres, header.numSpheres, sizeof(SphereRecord)));
+	const auto* cylinders = reinterpret_cast<const CylinderRecord*>(array(header.cylinders, header.numCylinders, sizeof(CylinderRecord)));
+	const auto* triangles = reinterpret_cast<const TriangleRecord*>(array(header.triangles, header.numTriangles, sizeof(TriangleRecord)));
+	auto string = [&](uint32_t index) {
+		if (index >= header.numStrings || strings[index].offset > file.size() || strings[index].length > file.size() - strings[index].offset) {
+			throw std::runtime_error("Corrupt compiled scene: " + filename);
+		}
+		return std::string(reinterpret_cast<const char*>(data) + strings[index].offset, strings[index].length);
+	};
 
-		} else {
-			material = Material(0.5f, 0.5f, 32, Color(1, 1, 1), Color(1, 1, 1), false, 0.0f, false, 1.0f);
+	nbounces = header.nbounces;
+	if (nbounces > MAX_BOUNCES) {
+		throw std::runtime_error("nbounces is limited to " + std::to_string(MAX_BOUNCES) + ": " + filename);
+	}
+	rendermode = string(header.renderMode);
+	renderMode = rendermode == "binary" ? RenderMode::Binary : rendermode == "phong" ? RenderMode::Phong : RenderMode::Other;
+	if (header.cameraType == Pinhole) {
+		camera = std::make_shared<PinholeCamera>(
+				header.width, header.height,
+				Vector3(header.position[0], header.position[1], header.position[2]),
+				Vector3(header.lookAt[0], header.lookAt[1], header.lookAt[2]),
+				Vector3(header.upVector[0], header.upVector[1], header.upVector[2]),
+				header.fov, header.exposure
+		);
+	}
+	scene.setBackgroundColor(Color(header.backgroundColor[0], header.backgroundColor[1], header.backgroundColor[2]));
+	for (uint32_t i = 0; i < header.numLights; ++i) {
+		scene.addLight(std::make_shared<PointLight>(
+				Vector3(lights[i].position[0], lights[i].position[1], lights[i].position[2]),
+				Color(lights[i].intensity[0], lights[i].intensity[1], lights[i].intensity[2])
+		));
+	}
+
+	std::string geometryKey = cache ? "compiled:" + std::filesystem::absolute(filename).string() : std::string();
+	std::vector<std::shared_ptr<Shape>> shapes;
+	if (cache && cache->findGeometry(geometryKey, shapes)) {
+		shapePool = nullptr;
+		for (const std::shared_ptr<Shape>& shape : shapes) {
+			scene.addShape(shape);
 		}
-		if (shapeData["type"] == "sphere") {
-			scene.addShape(std::make_shared<Sphere>(
-					Vector3(shapeData["center"][0], shapeData["center"][1], shapeData["center"][2]),
-					shapeData["radius"],
-					material
-			));
-		} else if (shapeData["type"] == "cylinder") {
-			scene.addShape(std::make_shared<Cylinder>(
-					Vector3(shapeData["center"][0], shapeData["center"][1], shapeData["center"][2]),
-					Vector3(shapeData["axis"][0], shapeData["axis"][1], shapeData["axis"][2]),
-					shapeData["radius"],
-					shapeData["height"],
-					material
-			));
-		} else if (shapeData["type"] == "triangle") {
-			scene.addShape(std::make_shared<Triangle>(
-					Vector3(shapeData["v0"][0], shapeData["v0"][1], shapeData["v0"][2]),
-					Vector3(shapeData["v1"][0], shapeData["v1"][1], shapeData["v1"][2]),
-					Vector3(shapeData["v2"][0], shapeData["v2"][1], shapeData["v2"][2]),
-					material
-			));
+		return;
+	}
+
+	// Each distinct material (and its texture) is built once; shapes copy it
+	std::vector<Material> sceneMaterials;
+	sceneMaterials.reserve(header.numMaterials);
+	for (uint32_t i = 0; i < header.numMaterials; ++i) {
+		const MaterialRecord& record = materials[i];
+		Material material(record.ks, record.kd, record.specularExponent,
+						  Color(record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]),
+						  Color(record.specularColor[0], record.specularColor[1], record.specularColor[2]),
+						  record.isReflective != 0, record.reflectivity, record.isRefractive != 0, record.refractiveIndex);
+		if (record.texture >= 0) {
+			ColorSpace colorSpace = record.colorSpace == 1 ? ColorSpace::SRGB : ColorSpace::Linear;
+			material.setTexture(loadTexture(string(static_cast<uint32_t>(record.texture)), colorSpace, cache));
+		}
+		sceneMaterials.push_back(material);
+	}
+	auto materialAt = [&](uint32_t index) -> const Material& {
+		if (index >= sceneMaterials.size()) {
+			throw std::runtime_error("Corrupt compiled scene: " + filename);
+		}
+		return sceneMaterials[index];
+	};
+
+	shapePool = ShapePool::create();
+	shapePool->reserve<Sphere>(header.numSpheres);
+	shapePool->reserve<Cylinder>(header.numCylinders);
+	shapePool->reserve<Triangle>(header.numTriangles);
+	shapePool->allocate();
+	shapes.reserve(header.numShapes);
+	for (uint32_t i = 0; i < header.numShapes; ++i) {
+		const ShapeRecord& shape = shapeRecords[i];
+		if (shape.type == SphereShape && shape.index < header.numSpheres) {
+			const SphereRecord& sphere = spheres[shape.index];
+			shapes.push_back(shapePool->create<Sphere>(
+					Vector3(sphere.center[0], sphere.center[1], sphere.center[2]), sphere.radius, materialAt(sphere.material)));
+		} else if (shape.type == CylinderShape && shape.index < header.numCylinders) {
+			const CylinderRecord& cylinder = cylinders[shape.index];
+			shapes.push_back(shapePool->create<Cylinder>(
+					Vector3(cylinder.center[0], cylinder.center[1], cylinder.center[2]),
+					Vector3(cylinder.axis[0], cylinder.axis[1], cylinder.axis[2]),
+					cylinder.radius, cylinder.height, materialAt(cylinder.material)));
+		} else if (shape.type == TriangleShape && shape.index < header.numTriangles) {
+			const TriangleRecord& triangle = triangles[shape.index];
+			shapes.push_back(shapePool->create<Triangle>(
+					Vector3(triangle.v0[0], triangle.v0[1], triangle.v0[2]),
+					Vector3(triangle.v1[0], triangle.v1[1], triangle.v1[2]),
+					Vector3(triangle.v2[0], triangle.v2[1], triangle.v2[2]), materialAt(triangle.material)));
+		} else {
+			throw std::runtime_error("Corrupt compiled scene: " + filename);
 		}
 	}
-	return Image(camera->getWidth(), camera->getHeight());
-}
 
+	for (const std::shared_ptr<Shape>& shape : shapes) {
+		scene.addShape(shape);
+	}
+	if (cache) {
+		cache->storeGeometry(geometryKey, shapes);
+	}
+}
@@ -1,7 +1,10 @@
 #ifndef RAYTRACER_RAYTRACER_H
 #define RAYTRACER_RAYTRACER_H
 #include "json.hpp"
+#include <array>
 #include <fstream>
+#include <memory>
+#include <functional>
 #include "Image.h"
 #include "Scene.h"
 #include "Camera.h"
@@ -11,24 +14,167 @@
 #include "Shape.h"
 #include "Light.h"
 #include "Material.h"
+#include "TaskScheduler.h"
+#include "TileOrder.h"
+#include "NumaTopology.h"
+#include "AssetCache.h"
+#include "TextureCache.h"
+#include "MediumStack.h"
+#include "PathQueue.h"
+#include "AllocationCounter.h"
 
 #define Ka 0.2f
 
+/*
+ * Distribution of tile render times: count, sum, min and max, plus a histogram of 8 log-spaced
+ * buckets per doubling from 1 us to about a minute. Its size is fixed whatever the tile count,
+ * so a gigapixel frame keeps no per-tile state.
+ */
+struct TileTimeHistogram {
+	static const int bucketsPerDoubling = 8;
+	static const int numBuckets = 26 * bucketsPerDoubling;	// 1 us * 2^26 is 67 s; slower tiles land in the last one
+	std::array<long long, numBuckets> buckets{};
+	long long count = 0;
+	double sum = 0.0;	// (s)
+	double min = 0.0;
+	double max = 0.0;
+
+	void add(double seconds);
+	void merge(const TileTimeHistogram& other);
+	// Time within which fraction p of the tiles finished, to a bucket's width (9%); exact for 0 and 1
+	double percentile(double p) const;
+};
+
+/* Timings of one render() call, used to compare schedulers */
+struct RenderStats {
+	double totalTime = 0.0;					// wall-clock time of the frame (s)
+	TileTimeHistogram tileTimes;			// time spent on each tile (s)
+	std::vector<double> threadFinishTimes;	// when each thread finished its last tile, from frame start (s)
+	long long allocations = 0;				// heap allocations made while tracing the tiles
+	long long textureHits = 0;				// paged texel lookups served from memory (see TextureCache)
+	long long textureMisses = 0;			// paged texel lookups that had to read a tile first
+};
+
+/* Limits of Raytracer::renderProgressive; whichever is reached first ends the render */
+struct ProgressiveSettings {
+	double timeBudget = 0.0;	// wall-clock deadline in seconds from the call, <= 0 for none
+	int maxSamples = 16;		// samples per pixel to stop at
+	int coarseBlock = 4;		// the first pass traces one ray per coarseBlock x coarseBlock pixels
+	uint32_t seed = 0;			// jitter depends only on (seed, pixel, sample): same image for any thread count
+};
+
+// Called on the rendering thread after every pass with the current best image
+using PassCallback = std::function<void(const Image& image, int pass, int samplesPerPixel)>;
+// Called from a rendering thread once rows [y0, y1) of the image are final (see StreamingWriter)
+using RowsCallback = std::function<void(int y0, int y1)>;
+
+enum class RenderMode {
+	Binary,	// red where a ray hits anything
+	Phong,
+	Other	// unknown mode: every pixel gets the background
+};
+
+// How tracePixel walks the ray tree; both produce the same image
+enum class Integrator {
+	Recursive,	// traceRay calling itself per reflected/refracted ray
+	Iterative	// traceIterative popping rays off a per-thread PathQueue
+};
+
 class Raytracer {
 	private:
 		int nbounces;
 		std::string rendermode;
+		RenderMode renderMode = RenderMode::Other;	// rendermode parsed once, so the trace path compares no strings
 		std::shared_ptr<Camera> camera = nullptr;
 		Scene scene;
+		std::shared_ptr<ShapePool> shapePool = nullptr;	// memory of the shapes readJSON built
+
+		int tileSize = 16;	// tiles are the unit of work handed to threads
+		TileOrder tileOrder = TileOrder::RowMajor;	// order of tiles, and of pixels inside each tile
+		std::shared_ptr<TaskScheduler> scheduler = nullptr;	// null -> OpenMP dynamic schedule over tiles
+		int splitDepth = 2;	// with a scheduler, branching rays above this depth become stealable tasks
+		Integrator integrator = Integrator::Recursive;
+		PixelFormat framebufferFormat = PixelFormat::RGB32F;	// of the images createImage() returns
+		TextureFilter textureFilter = TextureFilter::Trilinear;
+		TextureLayout textureLayout = TextureLayout::Tiled;	// of the textures loadJSON() loads
+		std::shared_ptr<TextureCache> textureCache = nullptr;	// null -> textures are loaded whole
+		bool streamJSON = false;	// loadJSON() parses with SAX instead of building the whole tree
+
+		NumaMode numaMode = NumaMode::None;
+		NumaTopology topology;
+		std::vector<std::shared_ptr<const Scene>> sceneReplicas;	// one per node in NumaMode::Replicate
+
+		const Scene& sceneForThread() const;	// the calling thread's node-local copy of the scene
+		bool usesScheduler() const;	// tiles and split rays go through scheduler (not with static tile ownership)
+
+		void renderTile(Image& image, Image* radiance, int x0, int y0, int x1, int y1, const std::vector<int>& pixelOrder) const;
+		void forEachTile(const TraversalOrder& tileSequence, const std::function<void(int tile, int thread)>& runTile) const;
+		Color tracePixel(float px, float py, int width, int height) const;	// radiance through image point (px, py)
+		Color toneMap(Color radiance) const;	// exposure + linear tone mapping
+
+		// Pieces of a bounce shared by traceRay and traceIterative
+		Color missColor() const;
+		Color shadeSurface(const Ray& ray, float t, const Shape* hitObject) const;	// Blinn-Phong + texture
+		bool refract(const Ray& ray, const Vector3& intersectionPoint, const Vector3& normal, const Material& material,
+					 const MediumStack& media, Vector3& origin, Vector3& direction, bool& entering) const;	// false on total internal reflection
+		Ray reflect(const Ray& ray, float t, const Vector3& intersectionPoint, const Vector3& normal) const;
+		static bool updateMedia(MediumStack& media, bool entering, const Material& material, Medium& exited);	// false if nothing changed
+		static void restoreMedia(MediumStack& media, bool entering, const Medium& exited);
+
+		// Texture of a material, through the texture cache or asset cache when there is one
+		std::shared_ptr<const Texture> loadTexture(const std::string& path, ColorSpace colorSpace, AssetCache* cache) const;
+
+		// Scene JSON to scene, one piece at a time; shared by the DOM and the streaming loader
+		void loadSettings(const nlohmann::json& j, const std::string& filename);	// nbounces, rendermode, camera, background
+		void addLight(const nlohmann::json& lightData);
+		static void reserveShape(ShapePool& pool, const nlohmann::json& shapeData);
+		std::shared_ptr<Shape> createShape(const nlohmann::json& shapeData, AssetCache* cache);	// in shapePool; null for unknown types
+		// loadJSON with setJSONStreaming(true): two SAX passes over the mapped file (count the shapes, then
+		// build them), so memory holds one shape's JSON at a time. With a cache only textures are shared
+		void loadJSONStreaming(const std::string& filename, AssetCache* cache);
 
 	public:
 		Raytracer();
-		void render(Image& image);
-		Color traceRay(const Ray& ray, int depth, std::stack<float> refractiveStack);
-		Color shadeBlinnPhong(const Ray& ray, float& t, std::shared_ptr<Shape> hitObject);
+		// render() may run traceRay from many threads at once: the whole trace path is const
+		// and only reads the scene, camera and materials loaded by readJSON.
+		// With radiance (same size as image), the unclamped radiance before exposure and tone mapping
+		// is kept there too: write it as PFM and re-tone-map it later with toneMapImage()
+		// onRowsFinished gets every band of rows as soon as all its tiles are done, in completion order.
+		RenderStats render(Image& image, Image* radiance = nullptr, const RowsCallback& onRowsFinished = nullptr) const;
+		// Coarse preview first, then one more sample per pixel each pass into an accumulation
+		// buffer until settings are met. Returns the samples per pixel every pixel received.
+		int renderProgressive(Image& image, const ProgressiveSettings& settings, const PassCallback& onPass = nullptr) const;
+		Color traceRay(const Ray& ray, int depth, MediumStack& media) const;	// leaves media as it found it
+		Color traceIterative(const Ray& primaryRay) const;	// same result as traceRay, without recursion
+		Color shadeBlinnPhong(const Ray& ray, float t, const Shape* hitObject) const;
+
+		void setTaskScheduler(std::shared_ptr<TaskScheduler> _scheduler);
+		void setTileSize(int _tileSize);
+		void setTileOrder(TileOrder _tileOrder);
+		void setIntegrator(Integrator _integrator);
+		void setFramebufferFormat(PixelFormat _format);
+		void setTextureFilter(TextureFilter _filter);
+		void setTextureLayout(TextureLayout _layout);	// applies to scenes loaded afterwards
+		void setTextureCache(std::shared_ptr<TextureCache> _cache);	// page textures of scenes loaded afterwards
+		void setJSONStreaming(bool _stream);	// applies to scenes loaded afterwards
+		void setNumaMode(NumaMode _numaMode);	// call after readJSON: Replicate copies the loaded scene
+
+		// Framebuffer for the loaded camera; with NumaMode::FirstTouch and up each tile's
+		// pages are first touched by the thread that will render that tile
+		Image createImage() const;
+
+		// Framebuffer in a memory-mapped P6 file (see Image::mapPPM); render() evicts finished rows
+		Image createMappedImage(const std::string& filename) const;
 
-		//read json method
-		Image readJSON(const std::string& filename);
+		//read json method; with a cache, textures and identical shape lists are shared across scenes
+		Image readJSON(const std::string& filename, AssetCache* cache = nullptr);
+		void loadJSON(const std::string& filename, AssetCache* cache = nullptr);	// readJSON without allocating an image
+		// Scene compiled by SceneFile::compile, used in place from a memory map. With a cache, the shapes
+		// are shared with earlier loads of the same file
+		void loadCompiled(const std::string& filename, AssetCache* cache = nullptr);
+		void loadScene(const std::string& filename, AssetCache* cache = nullptr);	// loadCompiled for .rts files, else loadJSON
+		const ShapePool* getShapePool() const;	// null if the shapes came from the cache
+		float getExposure() const;	// of the loaded camera
 
 };
 
@@ -1,6 +1,7 @@
 #include "Scene.h"
 
 #include <iostream>
+#include <map>
 
 
 Scene::Scene(Color backgroundColor) : backgroundColor(backgroundColor){}
@@ -8,6 +9,29 @@ Scene::Scene(Color backgroundColor, std::vector<std::shared_ptr<Shape> > shapes,
 		: backgroundColor(backgroundColor), shapes(shapes), lights(lights) {}
 Scene::~Scene(){}
 
+Scene Scene::replicate() const {
+	Scene copy(backgroundColor);
+	std::map<const Texture*, std::shared_ptr<const Texture>> textureCopies;	// textures shared by several shapes are copied once
+	std::shared_ptr<ShapePool> pool = ShapePool::create();
+	for (const std::shared_ptr<Shape>& shape : shapes) {
+		shape->reserveIn(*pool);
+	}
+	pool->allocate();
+	for (const std::shared_ptr<Shape>& shape : shapes) {
+		std::shared_ptr<Shape> shapeCopy = shape->cloneInto(*pool);
+		Material material = shape->getMaterial();
+		if (material.hasTextureMap()) {
+			std::shared_ptr<const Texture>& texture = textureCopies[&material.getTexture()];
+			if (!texture) texture = std::make_shared<const Texture>(material.getTexture());
+			material.setTexture(texture);
+			shapeCopy->setMaterial(material);
+		}
+		copy.addShape(shapeCopy);
+	}
+	copy.lights = lights;	// a handful of point lights: sharing them costs nothing
+	return copy;
+}
+
 void Scene::addShape(std::shared_ptr<Shape> shape){
 	shapes.push_back(shape);
 }
@@ -15,10 +39,10 @@ void Scene::addLight(std::shared_ptr<Light> light){
 	lights.push_back(light);
 }
 
-std::shared_ptr<Shape> Scene::intersect(const Ray& ray, float& t, bool limitDistance, float maxDistance, std::shared_ptr<Shape> hitObject){
+const Shape* Scene::intersect(const Ray& ray, float& t, bool limitDistance, float maxDistance, const Shape* hitObject) const {
 	//Iterates over all shapes to find the closest intersection.
 	float tmin = INFINITY;
-	std::shared_ptr<Shape> lastHitObject = nullptr;
+	const Shape* lastHitObject = nullptr;
 
 	for (const std::shared_ptr<Shape>& shape : shapes){
 		float tShape;	//distance t where the ray intersects the shape
@@ -26,7 +50,7 @@ std::shared_ptr<Shape> Scene::intersect(const Ray& ray, float& t, bool limitDist
 		if (shape->intersect(ray, tShape) && tShape < tmin && ((limitDistance && tShape < maxDistance /*&& hitObject != shape*/) || (!limitDistance))){
 			//DEBUG Does this work? hitObject != shape ;
 			tmin = tShape;
-			lastHitObject = shape;
+			lastHitObject = shape.get();
 		}
 	}
 	t = tmin;
@@ -36,7 +60,7 @@ std::shared_ptr<Shape> Scene::intersect(const Ray& ray, float& t, bool limitDist
 }
 
 bool Scene::isInShadow(const Vector3& intersectionPoint, const Vector3& lightDir,
-					   float lightDistance, const Vector3& surfaceNormal, std::shared_ptr<Shape> hitObject){
+					   float lightDistance, const Vector3& surfaceNormal, const Shape* hitObject) const {
 	float t;
 	float offset = 0.001f;
 	Ray shadowRay(intersectionPoint + surfaceNormal * offset, lightDir);	//ray from intersection point (plus offset) to light source
@@ -49,7 +73,7 @@ Color Scene::getBackgroundColor() const{
 
 //std::shared_ptr<Shape> Scene::getLastHitObject() const { return lastHitObject; }
 
-std::vector<std::shared_ptr<Light> > Scene::getLights() const { return lights; }
+const std::vector<std::shared_ptr<Light> >& Scene::getLights() const { return lights; }
 
 void Scene::setBackgroundColor(Color color){
 	backgroundColor = color;
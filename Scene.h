@@ -4,6 +4,7 @@
 #include "Light.h"
 #include "Color.h"
 #include <vector>
+#include <memory>
 #include <cmath>
 
 
@@ -18,13 +19,15 @@ class Scene {
 		Scene(Color backgroundColor);
 		Scene(Color backgroundColor, std::vector<std::shared_ptr<Shape>> shapes, std::vector<std::shared_ptr<Light>> lights);
 		~Scene();
+		Scene replicate() const;	// deep copy of the shapes and textures, allocated by the calling thread
 		void addShape(std::shared_ptr<Shape> shape);
 		void addLight(std::shared_ptr<Light> light);
-		std::shared_ptr<Shape> intersect(const Ray& ray, float& t, bool limitDistance, float maxDistance, std::shared_ptr<Shape> hitObject);
+		// Closest shape hit, or nullptr. Plain pointers on the trace path: no reference count traffic per ray
+		const Shape* intersect(const Ray& ray, float& t, bool limitDistance, float maxDistance, const Shape* hitObject) const;
 		Color getBackgroundColor() const;
-		std::vector<std::shared_ptr<Light>> getLights() const;
+		const std::vector<std::shared_ptr<Light>>& getLights() const;
 		void setBackgroundColor(Color color);
-		bool isInShadow(const Vector3& intersectionPoint, const Vector3& lightDir, float lightDistance, const Vector3& surfaceNormal, std::shared_ptr<Shape> hitObject);
+		bool isInShadow(const Vector3& intersectionPoint, const Vector3& lightDir, float lightDistance, const Vector3& surfaceNormal, const Shape* hitObject) const;
 		//Iterates over all shapes to find the closest intersection.
 };
 
@@ -0,0 +1,192 @@
+#include "SceneFile.h"
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include "json.hpp"
+#include "MediumStack.h"
+
+namespace {
+	void copyVector(const nlohmann::json& value, float* out) {
+		for (int i = 0; i < 3; ++i) out[i] = value[i];
+	}
+
+	// Appends a record array, 8-byte aligned; returns its offset
+	template <typename T>
+	uint64_t append(std::vector<char>& bytes, const T* records, size_t count) {
+		bytes.resize((bytes.size() + 7) & ~static_cast<size_t>(7), 0);
+		uint64_t offset = bytes.size();
+		const char* data = reinterpret_cast<const char*>(records);
+		bytes.insert(bytes.end(), data, data + count * sizeof(T));
+		return offset;
+	}
+
+	class Compiler {
+		private:
+			std::vector<std::string> strings;
+			std::map<std::string, uint32_t> stringIndices;
+			std::vector<SceneFile::MaterialRecord> materials;
+			std::map<std::string, uint32_t> materialIndices;	// by record bytes
+
+		public:
+			uint32_t intern(const std::string& text) {
+				auto found = stringIndices.find(text);
+				if (found != stringIndices.end()) return found->second;
+				strings.push_back(text);
+				return stringIndices[text] = static_cast<uint32_t>(strings.size() - 1);
+			}
+
+			// Same defaults and keys as Raytracer::loadJSON
+			uint32_t material(const nlohmann::json& shapeData) {
+				SceneFile::MaterialRecord record{};
+				record.texture = -1;
+				if (shapeData.contains("material")) {
+					const nlohmann::json& materialData = shapeData["material"];
+					record.ks = materialData["ks"];
+					record.kd = materialData["kd"];
+					record.specularExponent = materialData["specularexponent"];
+					copyVector(materialData["diffusecolor"], record.diffuseColor);
+					copyVector(materialData["specularcolor"], record.specularColor);
+					record.isReflective = materialData["isreflective"].get<bool>();
+					record.reflectivity = materialData["reflectivity"];
+					record.isRefractive = materialData["isrefractive"].get<bool>();
+					record.refractiveIndex = materialData["refractiveindex"];
+					if (materialData.contains("texture")) {
+						record.texture = static_cast<int32_t>(intern(materialData["texture"]));
+						std::string colorSpace = materialData.value("texturecolorspace", "linear");
+						if (colorSpace != "linear" && colorSpace != "srgb") {
+							throw std::runtime_error("Unknown color space: " + colorSpace);
+						}
+						record.colorSpace = colorSpace == "srgb" ? 1 : 0;
+					}
+				} else {
+					record.ks = 0.5f;
+					record.kd = 0.5f;
+					record.specularExponent = 32;
+					for (int i = 0; i < 3; ++i) record.diffuseColor[i] = record.specularColor[i] = 1.0f;
+					record.reflectivity = 0.0f;
+					record.refractiveIndex = 1.0f;
+				}
+
+				std::string key(reinterpret_cast<const char*>(&record), sizeof(record));
+				auto found = materialIndices.find(key);
+				if (found != materialIndices.end()) return found->second;
+				materials.push_back(record);
+				return materialIndices[key] = static_cast<uint32_t>(materials.size() - 1);
+			}
+
+			const std::vector<std::string>& getStrings() const { return strings; }
+			const std::vector<SceneFile::MaterialRecord>& getMaterials() const { return materials; }
+	};
+}
+
+void SceneFile::compile(const std::string& jsonFilename, const std::string& filename) {
+	std::ifstream input(jsonFilename);
+	if (!input) {
+		throw std::runtime_error("Could not open JSON file: " + jsonFilename);
+	}
+	nlohmann::json j = nlohmann::json::parse(input);
+	Compiler compiler;
+
+	Header header{};
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.byteOrder = byteOrderMark;
+	header.nbounces = j.contains("nbounces") ? j["nbounces"].get<int32_t>() : 1;
+	if (header.nbounces > MAX_BOUNCES) {
+		throw std::runtime_error("nbounces is limited to " + std::to_string(MAX_BOUNCES) + ": " + jsonFilename);
+	}
+	header.renderMode = compiler.intern(j["rendermode"]);
+
+	const nlohmann::json& camData = j["camera"];
+	if (camData["type"] == "pinhole") {
+		header.cameraType = Pinhole;
+		header.width = camData["width"];
+		header.height = camData["height"];
+		copyVector(camData["position"], header.position);
+		copyVector(camData["lookAt"], header.lookAt);
+		copyVector(camData["upVector"], header.upVector);
+		header.fov = camData["fov"];
+		header.exposure = camData["exposure"];
+	}
+
+	const nlohmann::json& sceneData = j["scene"];
+	copyVector(sceneData["backgroundcolor"], header.backgroundColor);
+
+	std::vector<LightRecord> lights;
+	if (sceneData.contains("lightsources")) {
+		for (const auto& lightData : sceneData["lightsources"]) {
+			if (lightData["type"] != "pointlight") continue;
+			LightRecord light{};
+			copyVector(lightData["position"], light.position);
+			copyVector(lightData["intensity"], light.intensity);
+			lights.push_back(light);
+		}
+	}
+
+	std::vector<ShapeRecord> shapes;
+	std::vector<SphereRecord> spheres;
+	std::vector<CylinderRecord> cylinders;
+	std::vector<TriangleRecord> triangles;
+	for (const auto& shapeData : sceneData["shapes"]) {
+		if (shapeData["type"] == "sphere") {
+			SphereRecord sphere{};
+			copyVector(shapeData["center"], sphere.center);
+			sphere.radius = shapeData["radius"];
+			sphere.material = compiler.material(shapeData);
+			shapes.push_back(ShapeRecord{SphereShape, static_cast<uint32_t>(spheres.size())});
+			spheres.push_back(sphere);
+		} else if (shapeData["type"] == "cylinder") {
+			CylinderRecord cylinder{};
+			copyVector(shapeData["center"], cylinder.center);
+			copyVector(shapeData["axis"], cylinder.axis);
+			cylinder.radius = shapeData["radius"];
+			cylinder.height = shapeData["height"];
+			cylinder.material = compiler.material(shapeData);
+			shapes.push_back(ShapeRecord{CylinderShape, static_cast<uint32_t>(cylinders.size())});
+			cylinders.push_back(cylinder);
+		} else if (shapeData["type"] == "triangle") {
+			TriangleRecord triangle{};
+			copyVector(shapeData["v0"], triangle.v0);
+			copyVector(shapeData["v1"], triangle.v1);
+			copyVector(shapeData["v2"], triangle.v2);
+			triangle.material = compiler.material(shapeData);
+			shapes.push_back(ShapeRecord{TriangleShape, static_cast<uint32_t>(triangles.size())});
+			triangles.push_back(triangle);
+		}
+	}
+
+	// Header first, arrays after it, string bytes last
+	std::vector<char> bytes(sizeof(Header));
+	const std::vector<std::string>& strings = compiler.getStrings();
+	std::vector<StringRecord> stringRecords(strings.size());
+	header.strings = append(bytes, stringRecords.data(), stringRecords.size());
+	header.lights = append(bytes, lights.data(), lights.size());
+	header.materials = append(bytes, compiler.getMaterials().data(), compiler.getMaterials().size());
+	header.shapes = append(bytes, shapes.data(), shapes.size());
+	header.spheres = append(bytes, spheres.data(), spheres.size());
+	header.cylinders = append(bytes, cylinders.data(), cylinders.size());
+	header.triangles = append(bytes, triangles.data(), triangles.size());
+	for (size_t i = 0; i < strings.size(); ++i) {
+		stringRecords[i] = StringRecord{bytes.size(), strings[i].size()};
+		bytes.insert(bytes.end(), strings[i].begin(), strings[i].end());
+	}
+	std::memcpy(bytes.data() + header.strings, stringRecords.data(), stringRecords.size() * sizeof(StringRecord));
+
+	header.numStrings = static_cast<uint32_t>(strings.size());
+	header.numLights = static_cast<uint32_t>(lights.size());
+	header.numMaterials = static_cast<uint32_t>(compiler.getMaterials().size());
+	header.numShapes = static_cast<uint32_t>(shapes.size());
+	header.numSpheres = static_cast<uint32_t>(spheres.size());
+	header.numCylinders = static_cast<uint32_t>(cylinders.size());
+	header.numTriangles = static_cast<uint32_t>(triangles.size());
+	header.fileSize = bytes.size();
+	std::memcpy(bytes.data(), &header, sizeof(header));
+
+	std::ofstream output(filename, std::ios::binary);
+	output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+	if (!output) {
+		throw std::runtime_error("Could not write compiled scene: " + filename);
+	}
+}
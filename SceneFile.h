@@ -0,0 +1,117 @@
+#ifndef RAYTRACER_SCENEFILE_H
+#define RAYTRACER_SCENEFILE_H
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+/*
+ * Compiled scene: everything loadJSON reads from a scene JSON, as flat arrays of fixed-size
+ * records that Raytracer::loadCompiled uses straight from a memory map. Nothing is parsed per
+ * shape; identical materials are stored once and referenced by index.
+ *
+ * Layout: Header, then the arrays at the offsets it gives (8-byte aligned), in host byte order.
+ * Files from a machine of the other byte order, or of another version, are rejected on load.
+ */
+namespace SceneFile {
+	const char magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+	const uint32_t version = 1;
+	const uint32_t byteOrderMark = 0x01020304;
+	const char extension[] = ".rts";
+
+	enum ShapeType : uint32_t {SphereShape = 0, CylinderShape = 1, TriangleShape = 2};
+	enum CameraType : uint32_t {NoCamera = 0, Pinhole = 1};
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		int32_t nbounces;
+		uint32_t renderMode;	// string index of "rendermode"
+		uint32_t cameraType;
+		int32_t width;
+		int32_t height;
+		float position[3];
+		float lookAt[3];
+		float upVector[3];
+		float fov;
+		float exposure;
+		float backgroundColor[3];
+		uint32_t numStrings;
+		uint32_t numLights;
+		uint32_t numMaterials;
+		uint32_t numShapes;
+		uint32_t numSpheres;
+		uint32_t numCylinders;
+		uint32_t numTriangles;
+		uint64_t strings;	// byte offsets of the arrays from the start of the file
+		uint64_t lights;
+		uint64_t materials;
+		uint64_t shapes;
+		uint64_t spheres;
+		uint64_t cylinders;
+		uint64_t triangles;
+		uint64_t fileSize;
+	};
+
+	// Strings (rendermode, texture paths) are StringRecords into the bytes that follow the array
+	struct StringRecord {
+		uint64_t offset;	// from the start of the file
+		uint64_t length;
+	};
+
+	struct LightRecord {
+		float position[3];
+		float intensity[3];
+	};
+
+	struct MaterialRecord {
+		float ks;
+		float kd;
+		int32_t specularExponent;
+		float diffuseColor[3];
+		float specularColor[3];
+		float reflectivity;
+		float refractiveIndex;
+		uint8_t isReflective;
+		uint8_t isRefractive;
+		uint8_t colorSpace;	// of the texture: 0 linear, 1 sRGB
+		uint8_t padding;
+		int32_t texture;	// string index of the texture path, -1 without a texture
+	};
+
+	// Scene order of the shapes: the index-th record of the type's array
+	struct ShapeRecord {
+		uint32_t type;
+		uint32_t index;
+	};
+
+	struct SphereRecord {
+		float center[3];
+		float radius;
+		uint32_t material;
+	};
+
+	struct CylinderRecord {
+		float center[3];
+		float axis[3];
+		float radius;
+		float height;
+		uint32_t material;
+	};
+
+	struct TriangleRecord {
+		float v0[3];
+		float v1[3];
+		float v2[3];
+		uint32_t material;
+	};
+
+	static_assert(std::is_trivially_copyable<Header>::value && std::is_trivially_copyable<MaterialRecord>::value,
+				  "records are read in place from the file");
+
+	// Reads a scene JSON and writes it compiled. Throws std::runtime_error on failure
+	void compile(const std::string& jsonFilename, const std::string& filename);
+}
+
+
+#endif //RAYTRACER_SCENEFILE_H
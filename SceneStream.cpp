@@ -0,0 +1,120 @@
+#include "SceneStream.h"
+#include <stdexcept>
+#include <vector>
+
+namespace {
+	class SceneSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+		private:
+			const SceneElementCallback& onElement;
+			const std::string& filename;
+
+			nlohmann::json root;
+			std::vector<nlohmann::json*> stack;	// open containers of root, innermost last
+			std::vector<std::string> stackKeys;	// key each of them was stored under ("" in arrays)
+			std::string lastKey;	// last key read
+
+			std::string streamedArray;	// "shapes" or "lightsources" while inside one, else empty
+			nlohmann::json element;	// element of the streamed array being built
+			std::vector<nlohmann::json*> elementStack;
+
+			// Stores value in the innermost open container (of root or of the current element)
+			bool insert(nlohmann::json&& value) {
+				bool container = value.is_structured();
+				if (!streamedArray.empty()) {
+					nlohmann::json* target;
+					if (elementStack.empty()) {
+						element = std::move(value);
+						target = &element;
+					} else if (elementStack.back()->is_object()) {
+						target = &((*elementStack.back())[lastKey] = std::move(value));
+					} else {
+						elementStack.back()->push_back(std::move(value));
+						target = &elementStack.back()->back();
+					}
+					if (container) elementStack.push_back(target);
+					else if (elementStack.empty()) onElement(streamedArray, element);	// a scalar element
+					return true;
+				}
+
+				nlohmann::json* target;
+				std::string storedKey;
+				if (stack.empty()) {
+					root = std::move(value);
+					target = &root;
+				} else if (stack.back()->is_object()) {
+					target = &((*stack.back())[lastKey] = std::move(value));
+					storedKey = lastKey;
+				} else {
+					stack.back()->push_back(std::move(value));
+					target = &stack.back()->back();
+				}
+				if (container) {
+					stack.push_back(target);
+					stackKeys.push_back(storedKey);
+				}
+				return true;
+			}
+
+			bool close() {
+				if (!streamedArray.empty()) {
+					if (elementStack.empty()) {
+						streamedArray.clear();	// the streamed array itself ended
+						return true;
+					}
+					elementStack.pop_back();
+					if (elementStack.empty()) {
+						onElement(streamedArray, element);
+						element = nullptr;
+					}
+					return true;
+				}
+				stack.pop_back();
+				stackKeys.pop_back();
+				return true;
+			}
+
+		public:
+			SceneSaxHandler(const SceneElementCallback& onElement, const std::string& filename)
+					: onElement(onElement), filename(filename) {}
+
+			nlohmann::json& getRoot() { return root; }
+
+			bool null() override { return insert(nullptr); }
+			bool boolean(bool value) override { return insert(value); }
+			bool number_integer(number_integer_t value) override { return insert(value); }
+			bool number_unsigned(number_unsigned_t value) override { return insert(value); }
+			bool number_float(number_float_t value, const string_t&) override { return insert(value); }
+			bool string(string_t& value) override { return insert(std::move(value)); }
+			bool binary(binary_t& value) override { return insert(nlohmann::json::binary(std::move(value))); }
+			bool key(string_t& value) override {
+				lastKey = std::move(value);
+				return true;
+			}
+
+			bool start_object(std::size_t) override { return insert(nlohmann::json::object()); }
+			bool end_object() override { return close(); }
+
+			bool start_array(std::size_t) override {
+				// scene.shapes and scene.lightsources are streamed; root keeps an empty array in their place
+				if (streamedArray.empty() && stack.size() == 2 && stackKeys[1] == "scene" && stack[1]->is_object() &&
+					(lastKey == "shapes" || lastKey == "lightsources")) {
+					(*stack[1])[lastKey] = nlohmann::json::array();
+					streamedArray = lastKey;
+					return true;
+				}
+				return insert(nlohmann::json::array());
+			}
+			bool end_array() override { return close(); }
+
+			bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) override {
+				throw std::runtime_error("Could not parse JSON file " + filename + ": " + error.what());
+			}
+	};
+}
+
+nlohmann::json parseSceneStreaming(const uint8_t* begin, const uint8_t* end, const SceneElementCallback& onElement,
+								   const std::string& filename) {
+	SceneSaxHandler handler(onElement, filename);
+	nlohmann::json::sax_parse(begin, end, &handler);
+	return std::move(handler.getRoot());
+}
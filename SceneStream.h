@@ -0,0 +1,22 @@
+#ifndef RAYTRACER_SCENESTREAM_H
+#define RAYTRACER_SCENESTREAM_H
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "json.hpp"
+
+// Gets "shapes" or "lightsources" and one complete element of that array
+using SceneElementCallback = std::function<void(const std::string& array, const nlohmann::json& element)>;
+
+/*
+ * Parses a scene JSON through json.hpp's SAX interface without ever holding the whole tree:
+ * every element of scene.shapes and scene.lightsources is built as a small DOM of its own,
+ * handed to onElement as soon as its closing brace is read, and dropped.
+ * Returns the rest of the document (settings, camera, background), where those two arrays
+ * are left empty. Throws std::runtime_error on malformed JSON.
+ */
+nlohmann::json parseSceneStreaming(const uint8_t* begin, const uint8_t* end, const SceneElementCallback& onElement,
+								   const std::string& filename);
+
+
+#endif //RAYTRACER_SCENESTREAM_H
@@ -5,14 +5,15 @@
 /* Shape class */
 Shape::Shape(const Material& material): material(material) {}
 
-Material Shape::getMaterial() const { return material; }
+const Material& Shape::getMaterial() const { return material; }
+void Shape::setMaterial(const Material& _material) { material = _material; }
 
 /* Sphere class */
 
 Sphere::Sphere(Vector3 center, float radius, const Material& material) : Shape(material), center(center), radius(radius) {}
 
 
-bool Sphere::intersect(const Ray& ray, float& t) {
+bool Sphere::intersect(const Ray& ray, float& t) const {
 
 	Vector3 L = ray.getOrigin() - center;
 	float a = dotProduct(ray.getDirection(), ray.getDirection());  // Should always be 1 if normalized
@@ -44,18 +45,18 @@ bool Sphere::intersect(const Ray& ray, float& t) {
 	return true;
 }
 
-Vector3 Sphere::getNormal(const Vector3& point) {
+Vector3 Sphere::getNormal(const Vector3& point) const {
 	return (point - center).normalize();
 }
 
-Color Sphere::getTextureColor(const Vector3& point, const Image& texture) {
+Color Sphere::getTextureColor(const Vector3& point, const Texture& texture, float footprint) const {
 	Vector3 normal = (point - center).normalize();  // Convert to normalized direction
 	float u = 0.5f + atan2(normal.z, normal.x) / (2.0f * M_PI);  // Azimuthal angle
 	float v = 0.5f - asin(normal.y) / M_PI;  // Polar angle
 
-	int texX = static_cast<int>(u * texture.getWidth()) % texture.getWidth();
-	int texY = static_cast<int>(v * texture.getHeight()) % texture.getHeight();
-	return texture.getPixelColor(texX, texY);
+	// u covers the circumference (2 pi r), v half of it: scale the footprint by their geometric mean
+	float uvPerUnit = 1.0f / (static_cast<float>(M_PI) * radius * std::sqrt(2.0f));
+	return texture.sample(u, v, footprint * uvPerUnit);
 }
 
 
@@ -65,7 +66,7 @@ Cylinder::Cylinder(Vector3 center, Vector3 axis, float radius, float height, con
 				Shape(material), center(center), axis(axis.normalize()), radius(radius), height(height*2.0) {}	//multiply height to match cw image
 
 
-bool Cylinder::intersect(const Ray& ray, float& t) {
+bool Cylinder::intersect(const Ray& ray, float& t) const {
 	Vector3 V = ray.getOrigin() - center;  // Vector from cylinder center to ray origin
 
 	// Intersect with the curved surface
@@ -136,7 +137,7 @@ bool Cylinder::isWithinHeight(const Vector3& point) const {
 	return projection >= -height / 2 && projection <= height / 2;
 }
 
-Vector3 Cylinder::getNormal(const Vector3& point){
+Vector3 Cylinder::getNormal(const Vector3& point) const {
 	// Check if the point is on the top or bottom base
 	float projectionHeight = dotProduct(point - center, axis);
 	if (projectionHeight >= height / 2.0f) {
@@ -157,7 +158,7 @@ Vector3 Cylinder::getNormal(const Vector3& point){
 	return normal.normalize();
 }
 
-Color Cylinder::getTextureColor(const Vector3& point, const Image& texture) {
+Color Cylinder::getTextureColor(const Vector3& point, const Texture& texture, float footprint) const {
 	Vector3 projection = point - center;
 	float heightCoord = dotProduct(projection, axis);
 	Vector3 radial = projection - axis * heightCoord;
@@ -165,9 +166,8 @@ Color Cylinder::getTextureColor(const Vector3& point, const Image& texture) {
 	float u = 0.5f + atan2(radial.z, radial.x) / (2.0f * M_PI);  // Map around the circumference
 	float v = (heightCoord + height / 2.0f) / height;  // Map along the height
 
-	int texX = static_cast<int>(u * texture.getWidth()) % texture.getWidth();
-	int texY = static_cast<int>(v * texture.getHeight()) % texture.getHeight();
-	return texture.getPixelColor(texX, texY);
+	float uvPerUnit = 1.0f / std::sqrt(2.0f * static_cast<float>(M_PI) * radius * height);
+	return texture.sample(u, v, footprint * uvPerUnit);
 }
 
 
@@ -177,7 +177,7 @@ Triangle::Triangle(Vector3 v0, Vector3 v1, Vector3 v2, const Material& material)
 										Shape(material), v0(v0), v1(v1), v2(v2) {}
 
 
-Vector3 Triangle::getNormal(const Vector3& rayDir) {	//Note that here point is the direction of the ray
+Vector3 Triangle::getNormal(const Vector3& rayDir) const {	//Note that here point is the direction of the ray
 	Vector3 E1 = v1 - v0;  // Edge 1: from v0 to v1
 	Vector3 E2 = v2 - v0;  // Edge 2: from v0 to v2
 	Vector3 normal = crossProduct(E1, E2).normalize();
@@ -187,7 +187,7 @@ Vector3 Triangle::getNormal(const Vector3& rayDir) {	//Note that here point is t
 	return normal;
 }
 
-bool Triangle::intersect(const Ray& ray, float& t) {
+bool Triangle::intersect(const Ray& ray, float& t) const {
 	Vector3 rayDir = ray.getDirection();
 	Vector3 E1 = v1 - v0;  // Edge 1: from v0 to v1
 	Vector3 E2 = v2 - v0;  // Edge 2: from v0 to v2
@@ -217,7 +217,7 @@ bool Triangle::intersect(const Ray& ray, float& t) {
 	return t > 0;  // Intersection is valid if t is positive
 }
 
-Color Triangle::getTextureColor(const Vector3& point, const Image& texture) {
+Color Triangle::getTextureColor(const Vector3& point, const Texture& texture, float footprint) const {
 	Vector3 E1 = v1 - v0;  // Edge 1
 	Vector3 E2 = v2 - v0;  // Edge 2
 	Vector3 P = point - v0;
@@ -229,8 +229,8 @@ Color Triangle::getTextureColor(const Vector3& point, const Image& texture) {
 	float texU = (1 - u - v) * 0.0f + u * 1.0f + v * 0.5f;  // Example texture coords
 	float texV = (1 - u - v) * 0.0f + u * 0.0f + v * 1.0f;
 
-	int texX = static_cast<int>(texU * texture.getWidth()) % texture.getWidth();
-	int texY = static_cast<int>(texV * texture.getHeight()) % texture.getHeight();
-	return texture.getPixelColor(texX, texY);
+	// The texture coordinates span a triangle of area 1/2 (area is twice the world-space one)
+	float uvPerUnit = std::sqrt(1.0f / area);
+	return texture.sample(texU, texV, footprint * uvPerUnit);
 }
 
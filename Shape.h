@@ -3,8 +3,10 @@
 #include "Material.h"
 #include "Ray.h"
 #include "Vector3.h"
-#include "Image.h"
+#include "Texture.h"
 #include <string>
+#include <memory>
+#include "ShapePool.h"
 
 
 class Shape {
@@ -13,14 +15,18 @@ class Shape {
 	public:
 		Shape(const Material& material);
 		virtual ~Shape() = default;
-		virtual bool intersect(const Ray& ray, float& t) = 0;
-		Material getMaterial() const;
+		virtual bool intersect(const Ray& ray, float& t) const = 0;
+		const Material& getMaterial() const;
+		void setMaterial(const Material& _material);
 		//Pure virtual function for intersection test.
-		virtual Vector3 getNormal(const Vector3& point) = 0; //note: triangle doesnt use point
+		virtual Vector3 getNormal(const Vector3& point) const = 0; //note: triangle doesnt use point
 		//Returns the surface normal at a point.
-		virtual Color getTextureColor(const Vector3& point, const Image& texture) = 0;
+		// footprint: world-space width of the ray cone on the surface at point (0: nearest texel)
+		virtual Color getTextureColor(const Vector3& point, const Texture& texture, float footprint) const = 0;
 		virtual std::string toString() const = 0;
-		virtual Vector3 getV0() = 0;	//DEBUG TODO: remove
+		virtual Vector3 getV0() const = 0;	//DEBUG TODO: remove
+		virtual void reserveIn(ShapePool& pool) const = 0;	// room for one more shape of this type
+		virtual std::shared_ptr<Shape> cloneInto(ShapePool& pool) const = 0;	// copy sharing the material's texture
 };
 
 
@@ -32,11 +38,13 @@ class Sphere : public Shape {
 		Sphere(Vector3 center, float radius, const Material& material);
 
 		//methods
-		bool intersect(const Ray& ray, float& t) override;
-		Vector3 getNormal(const Vector3& point) override;
-		Color getTextureColor(const Vector3& point, const Image& texture) override;
+		bool intersect(const Ray& ray, float& t) const override;
+		Vector3 getNormal(const Vector3& point) const override;
+		Color getTextureColor(const Vector3& point, const Texture& texture, float footprint) const override;
 		std::string toString() const override { return "Sphere"; }
-		Vector3 getV0() override { return 0; }	//DEBUG TODO: remove
+		void reserveIn(ShapePool& pool) const override { pool.reserve<Sphere>(1); }
+		std::shared_ptr<Shape> cloneInto(ShapePool& pool) const override { return pool.create<Sphere>(*this); }
+		Vector3 getV0() const override { return 0; }	//DEBUG TODO: remove
 };
 
 
@@ -50,12 +58,14 @@ class Cylinder : public Shape {
 		Cylinder(Vector3 center, Vector3 axis, float radius, float height, const Material& material);
 
 		//methods
-		bool intersect(const Ray& ray, float& t) override;
+		bool intersect(const Ray& ray, float& t) const override;
 		bool isWithinHeight(const Vector3& point) const;
-		Vector3 getNormal(const Vector3& point) override;
-		Color getTextureColor(const Vector3& point, const Image& texture) override;
+		Vector3 getNormal(const Vector3& point) const override;
+		Color getTextureColor(const Vector3& point, const Texture& texture, float footprint) const override;
 		std::string toString() const override { return "Cylinder"; }
-	 	Vector3 getV0() override { return 0; }	//DEBUG TODO: remove
+		void reserveIn(ShapePool& pool) const override { pool.reserve<Cylinder>(1); }
+		std::shared_ptr<Shape> cloneInto(ShapePool& pool) const override { return pool.create<Cylinder>(*this); }
+	 	Vector3 getV0() const override { return 0; }	//DEBUG TODO: remove
 };
 
 
@@ -68,11 +78,13 @@ class Triangle : public Shape {
 		Triangle(Vector3 v0, Vector3 v1, Vector3 v2, const Material& material);
 
 		//methods
-		bool intersect(const Ray& ray, float& t) override;
-		Vector3 getNormal(const Vector3& rayDir) override;
-		Color getTextureColor(const Vector3& point, const Image& texture) override;
+		bool intersect(const Ray& ray, float& t) const override;
+		Vector3 getNormal(const Vector3& rayDir) const override;
+		Color getTextureColor(const Vector3& point, const Texture& texture, float footprint) const override;
 		std::string toString() const override { return "Triangle"; }
-		Vector3 getV0() override { return v0; }	//DEBUG TODO: remove
+		void reserveIn(ShapePool& pool) const override { pool.reserve<Triangle>(1); }
+		std::shared_ptr<Shape> cloneInto(ShapePool& pool) const override { return pool.create<Triangle>(*this); }
+		Vector3 getV0() const override { return v0; }	//DEBUG TODO: remove
 };
 
 
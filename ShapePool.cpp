@@ -0,0 +1,103 @@
+#include "ShapePool.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const size_t segmentAlignment = 64;	// every type starts on its own cache line
+	const size_t hugePageSize = 2 * 1024 * 1024;
+
+	size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+std::shared_ptr<ShapePool> ShapePool::create() {
+	return std::shared_ptr<ShapePool>(new ShapePool());
+}
+
+ShapePool::~ShapePool() {
+	for (size_t i = objects.size(); i-- > 0;) {
+		destructors[i](objects[i]);
+	}
+	if (!mapping) return;
+#ifdef __linux__
+	munmap(mapping, mappingSize);
+#else
+	::operator delete(mapping, std::align_val_t(segmentAlignment));
+#endif
+}
+
+void ShapePool::allocate() {
+	if (block) throw std::logic_error("ShapePool: allocate called twice");
+	size_t numObjects = 0;
+	for (Segment& segment : segments) {
+		blockSize = alignUp(blockSize, std::max(segmentAlignment, segment.alignment));
+		segment.offset = blockSize;
+		blockSize += segment.capacity * segment.objectSize;
+		numObjects += segment.capacity;
+	}
+	objects.reserve(numObjects);
+	destructors.reserve(numObjects);
+	if (blockSize == 0) return;
+
+#ifdef __linux__
+	hugePages = blockSize >= hugePageSize;
+	// Huge pages must be 2 MB aligned: map one extra huge page and start the block on a boundary
+	mappingSize = hugePages ? alignUp(blockSize, hugePageSize) + hugePageSize : blockSize;
+	mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		mapping = nullptr;
+		throw std::bad_alloc();
+	}
+	block = static_cast<char*>(mapping);
+	if (hugePages) {
+		block = reinterpret_cast<char*>(alignUp(reinterpret_cast<uintptr_t>(mapping), hugePageSize));
+#ifdef MADV_HUGEPAGE
+		madvise(block, alignUp(blockSize, hugePageSize), MADV_HUGEPAGE);
+#else
+		hugePages = false;
+#endif
+	}
+#else
+	mappingSize = blockSize;
+	mapping = ::operator new(blockSize, std::align_val_t(segmentAlignment));
+	block = static_cast<char*>(mapping);
+#endif
+}
+
+ShapePool::Segment& ShapePool::segmentFor(std::type_index type) {
+	for (Segment& segment : segments) {
+		if (segment.type == type) return segment;
+	}
+	throw std::logic_error("ShapePool: shape type was not reserved");
+}
+
+void* ShapePool::allocateObject(std::type_index type) {
+	Segment& segment = segmentFor(type);
+	if (!block || segment.used == segment.capacity) {
+		throw std::logic_error("ShapePool: more shapes created than reserved");
+	}
+	return block + segment.offset + segment.objectSize * segment.used++;
+}
+
+size_t ShapePool::getBytes() const { return blockSize; }
+size_t ShapePool::getNumShapes() const { return objects.size(); }
+bool ShapePool::usesHugePages() const { return hugePages; }
+
+
+size_t residentSetBytes() {
+#ifdef __linux__
+	std::ifstream statm("/proc/self/statm");
+	size_t totalPages = 0, residentPages = 0;
+	if (statm >> totalPages >> residentPages) {
+		return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef RAYTRACER_SHAPEPOOL_H
+#define RAYTRACER_SHAPEPOOL_H
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+/*
+ * One block of memory holding every shape of a scene, all shapes of a type side by side
+ * (in the order they are created). Traversal then walks a few dense arrays instead of
+ * make_shared allocations scattered over the heap, each with its own control block.
+ *
+ * Use: reserve<T>() every shape first, allocate(), then create<T>() each of them.
+ * create() hands out shared_ptrs that share ownership of the whole pool, so the memory
+ * stays alive as long as any of its shapes is referenced (scene, replica or asset cache).
+ * On Linux the block is mmap'ed and, from 2 MB up, advised to use transparent huge pages.
+ */
+class ShapePool : public std::enable_shared_from_this<ShapePool> {
+	private:
+		struct Segment {
+			std::type_index type;
+			size_t objectSize;
+			size_t alignment;
+			size_t capacity = 0;	// objects reserved
+			size_t used = 0;		// objects created
+			size_t offset = 0;		// from the start of the block
+		};
+
+		std::vector<Segment> segments;
+		std::vector<void (*)(void*)> destructors;	// per created object, in creation order
+		std::vector<void*> objects;
+		char* block = nullptr;
+		void* mapping = nullptr;	// what to unmap/free (block may be aligned inside it)
+		size_t mappingSize = 0;
+		size_t blockSize = 0;
+		bool hugePages = false;
+
+		ShapePool() = default;
+		Segment& segmentFor(std::type_index type);
+		void* allocateObject(std::type_index type);
+
+	public:
+		static std::shared_ptr<ShapePool> create();
+		~ShapePool();
+		ShapePool(const ShapePool&) = delete;
+		ShapePool& operator=(const ShapePool&) = delete;
+
+		template <typename T>
+		void reserve(size_t count) {
+			if (block) throw std::logic_error("ShapePool: reserve after allocate");
+			for (Segment& segment : segments) {
+				if (segment.type == std::type_index(typeid(T))) {
+					segment.capacity += count;
+					return;
+				}
+			}
+			segments.push_back(Segment{std::type_index(typeid(T)), sizeof(T), alignof(T), count});
+		}
+
+		void allocate();	// maps one block for everything reserved
+
+		template <typename T, typename... Args>
+		std::shared_ptr<T> create(Args&&... args) {
+			T* object = new (allocateObject(std::type_index(typeid(T)))) T(std::forward<Args>(args)...);
+			objects.push_back(object);
+			destructors.push_back([](void* p) { static_cast<T*>(p)->~T(); });
+			return std::shared_ptr<T>(shared_from_this(), object);	// aliasing: no control block per shape
+		}
+
+		size_t getBytes() const;	// size of the block
+		size_t getNumShapes() const;
+		bool usesHugePages() const;	// huge pages were requested (the kernel may still decline)
+};
+
+size_t residentSetBytes();	// resident memory of the whole process, 0 if unknown
+
+
+#endif //RAYTRACER_SHAPEPOOL_H
@@ -0,0 +1,163 @@
+#include "StreamingWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+StreamingWriter::StreamingWriter(const Image& image, const std::string& filename, const OutputEncoding& encoding)
+		: image(image), filename(filename), encoder(encoding, image.getWidth()) {
+	std::string extension = std::filesystem::path(filename).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	format = extension == ".png" ? Format::PNG : extension == ".pfm" ? Format::PFM : Format::PPM;
+
+	int width = image.getWidth();
+	int height = image.getHeight();
+	scratch.resize(static_cast<size_t>(width) * 3);
+	finishedRows.assign(height, false);
+	queue.resize(std::max(height, 1));
+	bands.reserve(queue.size());
+
+	if (format == Format::PNG) {
+		png = std::make_unique<PNGStream>(filename, width, height, 1);
+		if (!png->good()) {
+			throw std::runtime_error("Could not create output file: " + filename);
+		}
+	} else {
+		// PFM data is written in the host's byte order, which the sign of the scale records
+		uint16_t probe = 1;
+		uint8_t lowByte;
+		std::memcpy(&lowByte, &probe, 1);
+		std::string scale = lowByte == 1 ? "-1.0" : "1.0";
+		std::string header = format == Format::PFM
+				? "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + scale + "\n"
+				: "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		rowBytes = static_cast<size_t>(width) * 3 * (format == Format::PFM ? sizeof(float) : 1);
+		headerSize = header.size();
+
+		file.open(filename, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Could not create output file: " + filename);
+		}
+		// Final size up front (unwritten rows read as black), so bands can land in any order
+		file.write(header.data(), static_cast<std::streamsize>(header.size()));
+		size_t fileSize = headerSize + rowBytes * static_cast<size_t>(height);
+		if (fileSize > headerSize) {
+			file.seekp(static_cast<std::streamoff>(fileSize - 1));
+			file.put('\0');
+		}
+		file.flush();
+	}
+
+	thread = std::thread(&StreamingWriter::run, this);
+}
+
+StreamingWriter::~StreamingWriter() {
+	if (thread.joinable()) finish();
+}
+
+void StreamingWriter::rowsFinished(int y0, int y1) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (queueCount == queue.size()) {
+			failed = true;	// rows reported more than once: the file cannot be trusted anyway
+			return;
+		}
+		queue[(queueFront + queueCount) % queue.size()] = {y0, y1};
+		++queueCount;
+	}
+	wakeUp.notify_one();
+}
+
+void StreamingWriter::run() {
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] { return closing || queueCount > 0; });
+			if (queueCount == 0) return;	// closing and drained
+			for (; queueCount > 0; --queueCount) {
+				bands.push_back(queue[queueFront]);
+				queueFront = (queueFront + 1) % queue.size();
+			}
+		}
+		for (const auto& rows : bands) {
+			try {
+				writeBand(std::max(rows.first, 0), std::min(rows.second, image.getHeight()));
+			} catch (const std::exception&) {
+				std::lock_guard<std::mutex> lock(mutex);
+				failed = true;
+			}
+		}
+		bands.clear();
+	}
+}
+
+void StreamingWriter::writeBand(int y0, int y1) {
+	int width = image.getWidth();
+	for (int y = y0; y < y1; ++y) {
+		if (!finishedRows[y]) ++rowsDone;
+		finishedRows[y] = true;
+	}
+
+	if (format == Format::PNG) {
+		// Compressed in image order: append the run of finished rows that continues the file
+		int end = nextRow;
+		while (end < image.getHeight() && finishedRows[end]) ++end;
+		if (end == nextRow) return;
+
+		size_t pngRowBytes = static_cast<size_t>(width) * 3;
+		band.resize(pngRowBytes * (end - nextRow));
+		for (int y = nextRow; y < end; ++y) {
+			image.quantizeRow(encoder, y, scratch.data(), band.data() + (y - nextRow) * pngRowBytes);
+		}
+		png->writeRows(band.data(), end - nextRow);
+		nextRow = end;
+		++bandsWritten;
+		return;
+	}
+
+	if (y1 <= y0) return;
+	band.resize(rowBytes * (y1 - y0));
+	size_t offset;
+	if (format == Format::PFM) {
+		// Rows are stored bottom to top: the band is contiguous but reversed
+		for (int y = y0; y < y1; ++y) {
+			uint8_t* out = band.data() + (y1 - 1 - y) * rowBytes;
+			image.decodeRow(y, scratch.data());
+			std::memcpy(out, scratch.data(), rowBytes);
+		}
+		offset = headerSize + static_cast<size_t>(image.getHeight() - y1) * rowBytes;
+	} else {
+		for (int y = y0; y < y1; ++y) {
+			image.quantizeRow(encoder, y, scratch.data(), band.data() + (y - y0) * rowBytes);
+		}
+		offset = headerSize + static_cast<size_t>(y0) * rowBytes;
+	}
+	file.seekp(static_cast<std::streamoff>(offset));
+	file.write(reinterpret_cast<const char*>(band.data()), static_cast<std::streamsize>(band.size()));
+	file.flush();	// in the OS's hands: survives the process dying
+	if (!file) {
+		throw std::runtime_error("Could not write to " + filename);
+	}
+	++bandsWritten;
+}
+
+bool StreamingWriter::finish() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	wakeUp.notify_one();
+	if (thread.joinable()) thread.join();
+
+	bool complete = !failed && rowsDone == image.getHeight();
+	if (png) {
+		complete = png->finish() && complete;
+	} else {
+		file.close();
+		complete = complete && !file.fail();
+	}
+	return complete;
+}
+
+int StreamingWriter::getBandsWritten() const { return bandsWritten; }
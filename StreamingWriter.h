@@ -0,0 +1,76 @@
+#ifndef RAYTRACER_STREAMINGWRITER_H
+#define RAYTRACER_STREAMINGWRITER_H
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Image.h"
+#include "ImageEncoder.h"
+#include "PNGWriter.h"
+
+/*
+ * Writes an image to its file while it is being rendered: render() reports every band of rows
+ * that will not change again and a background I/O thread encodes and writes it, so disk work
+ * overlaps tracing and a render that dies part way leaves every finished band on disk.
+ *
+ * PPM and PFM files are created at their final size and bands are written in place in whatever
+ * order they finish; PNG is a single compressed stream, so bands are appended in image order
+ * as soon as all rows above them are done, compressed on the I/O thread alone (the render already
+ * has every core). The format is picked from the extension like Image::write.
+ */
+class StreamingWriter {
+	private:
+		enum class Format {PPM, PFM, PNG};
+
+		const Image& image;
+		std::string filename;
+		Format format;
+		RowEncoder encoder;
+		size_t rowBytes = 0;	// in the file
+		size_t headerSize = 0;
+		std::ofstream file;	// PPM / PFM
+		std::unique_ptr<PNGStream> png;
+
+		std::mutex mutex;
+		std::condition_variable wakeUp;
+		// Finished bands [y0, y1) not written yet, in a ring allocated up front: every row is finished
+		// once, so at most height bands are ever queued and render threads never allocate
+		std::vector<std::pair<int, int>> queue;
+		size_t queueFront = 0;
+		size_t queueCount = 0;
+		bool closing = false;
+		bool failed = false;
+		std::thread thread;
+
+		// owned by the I/O thread
+		std::vector<bool> finishedRows;
+		int rowsDone = 0;
+		int nextRow = 0;	// PNG: rows [0, nextRow) are in the file
+		std::vector<std::pair<int, int>> bands;	// taken from the queue
+		std::vector<float> scratch;
+		std::vector<uint8_t> band;
+		int bandsWritten = 0;
+
+		void run();
+		void writeBand(int y0, int y1);
+
+	public:
+		StreamingWriter(const Image& image, const std::string& filename, const OutputEncoding& encoding = OutputEncoding());
+		~StreamingWriter();
+		StreamingWriter(const StreamingWriter&) = delete;
+		StreamingWriter& operator=(const StreamingWriter&) = delete;
+
+		// Rows [y0, y1) of image are final; each row may be reported once. Only queues the band (no
+		// allocation); safe from any rendering thread.
+		void rowsFinished(int y0, int y1);
+		// Waits for the queued bands and completes the file; false if anything failed or rows are missing
+		bool finish();
+		int getBandsWritten() const;	// after finish()
+};
+
+
+#endif //RAYTRACER_STREAMINGWRITER_H
@@ -0,0 +1,154 @@
+#include "TaskScheduler.h"
+#include <omp.h>
+
+namespace {
+	thread_local int workerIndex = -1;	// which deque belongs to this thread
+	thread_local unsigned int stealSeed = 0;
+	thread_local int waitDepth = 0;	// nested wait() calls on this thread
+
+	// A waiting thread that steals may end up waiting again inside the stolen task;
+	// past this nesting it only runs its own deque (its children and their descendants, which the
+	// task tree bounds) and stops stealing, so unrelated work cannot keep deepening the native stack.
+	const int maxHelpDepth = 4;
+}
+
+TaskScheduler::TaskScheduler(int numThreads, const std::function<void(int worker)>& threadInit) {
+	if (numThreads <= 0) {
+		numThreads = omp_get_max_threads();
+	}
+	for (int i = 0; i < numThreads; ++i) {
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	// worker 0 is whoever drives the pool (spawn/wait from outside)
+	for (int i = 1; i < numThreads; ++i) {
+		threads.emplace_back(&TaskScheduler::workerLoop, this, i, threadInit);
+	}
+}
+
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+int TaskScheduler::getNumThreads() const { return static_cast<int>(queues.size()); }
+
+int TaskScheduler::currentWorker() { return workerIndex; }
+
+
+void TaskScheduler::spawn(TaskGroup& group, Task task) {
+	if (workerIndex < 0) workerIndex = 0;
+
+	group.pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		WorkerQueue& queue = *queues[workerIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.pushBack(Job{std::move(task), &group});
+	}
+	queuedTasks.fetch_add(1);
+
+	if (sleepingWorkers.load() > 0) {
+		// take the lock so a worker between its predicate check and wait() cannot miss the signal
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeUp.notify_one();
+	}
+}
+
+void TaskScheduler::wait(TaskGroup& group) {
+	if (workerIndex < 0) workerIndex = 0;
+
+	// Never block while the group is pending: keep executing (or stealing) work instead
+	++waitDepth;
+	while (!group.done()) {
+		if (!runOne(workerIndex, waitDepth <= maxHelpDepth)) {
+			std::this_thread::yield();
+		}
+	}
+	--waitDepth;
+}
+
+
+void TaskScheduler::workerLoop(int index, std::function<void(int worker)> threadInit) {
+	workerIndex = index;
+	if (threadInit) threadInit(index);
+	stealSeed = static_cast<unsigned int>(index) * 2654435761u + 1u;
+
+	while (!stopping.load(std::memory_order_relaxed)) {
+		if (runOne(index)) continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers.fetch_add(1);
+		wakeUp.wait(lock, [this] { return stopping.load() || queuedTasks.load() > 0; });
+		sleepingWorkers.fetch_sub(1);
+	}
+}
+
+bool TaskScheduler::popLocal(int index, Job& job) {
+	WorkerQueue& queue = *queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.count == 0) return false;
+	job = queue.popBack();	// newest first: depth-first on our own tasks
+	return true;
+}
+
+bool TaskScheduler::steal(int thief, Job& job) {
+	int numQueues = getNumThreads();
+	stealSeed = stealSeed * 1103515245u + 12345u;
+	int start = static_cast<int>((stealSeed >> 16) % static_cast<unsigned int>(numQueues));
+
+	for (int i = 0; i < numQueues; ++i) {
+		int victim = (start + i) % numQueues;
+		if (victim == thief) continue;
+
+		WorkerQueue& queue = *queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count == 0) continue;
+		job = queue.popFront();	// oldest first: the biggest chunk of remaining work
+		return true;
+	}
+	return false;
+}
+
+bool TaskScheduler::runOne(int index, bool allowSteal) {
+	Job job;
+	if (!popLocal(index, job) && !(allowSteal && steal(index, job))) {
+		return false;
+	}
+	queuedTasks.fetch_sub(1);
+
+	job.task();
+	job.group->pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+
+void TaskScheduler::WorkerQueue::pushBack(Job&& job) {
+	if (count == jobs.size()) {
+		// full: unroll into a buffer twice the size, oldest job first
+		std::vector<Job> grown(jobs.size() * 2);
+		for (size_t i = 0; i < count; ++i) {
+			grown[i] = std::move(jobs[(front + i) % jobs.size()]);
+		}
+		jobs.swap(grown);
+		front = 0;
+	}
+	jobs[(front + count) % jobs.size()] = std::move(job);
+	++count;
+}
+
+TaskScheduler::Job TaskScheduler::WorkerQueue::popBack() {
+	--count;
+	return std::move(jobs[(front + count) % jobs.size()]);
+}
+
+TaskScheduler::Job TaskScheduler::WorkerQueue::popFront() {
+	Job job = std::move(jobs[front]);
+	front = (front + 1) % jobs.size();
+	--count;
+	return job;
+}
@@ -0,0 +1,77 @@
+#ifndef RAYTRACER_TASKSCHEDULER_H
+#define RAYTRACER_TASKSCHEDULER_H
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Counts the tasks spawned into it that have not finished yet. */
+class TaskGroup {
+	private:
+		std::atomic<int> pending{0};
+		friend class TaskScheduler;
+	public:
+		bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+
+/*
+ * Work-stealing thread pool.
+ * Every worker owns a deque: it pushes and pops its own tasks at the back (depth first, cache warm)
+ * while idle workers steal from the front of other deques (the oldest, usually biggest, tasks).
+ * The thread calling wait() joins in as worker 0, so a pool of N threads starts N-1 extra threads.
+ */
+class TaskScheduler {
+	public:
+		using Task = std::function<void()>;
+
+		// numThreads 0 -> omp_get_max_threads(); threadInit runs first on every worker thread (e.g. pinning)
+		explicit TaskScheduler(int numThreads = 0, const std::function<void(int worker)>& threadInit = nullptr);
+		~TaskScheduler();
+		TaskScheduler(const TaskScheduler&) = delete;
+		TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+		int getNumThreads() const;
+		static int currentWorker();	// index of the calling worker, -1 outside the pool
+
+		void spawn(TaskGroup& group, Task task);	// queue task on the calling worker's deque
+		void wait(TaskGroup& group);	// run and steal tasks until every task of group has finished
+
+	private:
+		struct Job {
+			Task task;
+			TaskGroup* group = nullptr;
+		};
+
+		// Ring buffer of jobs: unlike std::deque it keeps its storage when emptied, so once
+		// it has grown to the deepest backlog spawning and popping never allocate
+		struct WorkerQueue {
+			std::mutex mutex;
+			std::vector<Job> jobs = std::vector<Job>(64);
+			size_t front = 0;	// index of the oldest job
+			size_t count = 0;
+
+			void pushBack(Job&& job);
+			Job popBack();
+			Job popFront();
+		};
+
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		std::vector<std::thread> threads;
+		std::atomic<int> queuedTasks{0};
+		std::atomic<int> sleepingWorkers{0};
+		std::atomic<bool> stopping{false};
+		std::mutex sleepMutex;
+		std::condition_variable wakeUp;
+
+		void workerLoop(int index, std::function<void(int worker)> threadInit);
+		bool popLocal(int index, Job& job);
+		bool steal(int thief, Job& job);
+		bool runOne(int index, bool allowSteal = true);
+};
+
+
+#endif //RAYTRACER_TASKSCHEDULER_H
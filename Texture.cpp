@@ -0,0 +1,440 @@
+#include "Texture.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include "PNM.h"
+#include "TextureCache.h"
+
+namespace {
+	const char compressedMagic[8] = {'R', 'T', 'B', 'C', '1', 'T', 'E', 'X'};
+
+	std::array<float, 256> makeDecodeTable(ColorSpace colorSpace) {
+		std::array<float, 256> table{};
+		for (int i = 0; i < 256; ++i) {
+			float value = static_cast<float>(i) / 255.0f;
+			if (colorSpace == ColorSpace::SRGB) {
+				value = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			}
+			table[i] = value;
+		}
+		return table;
+	}
+
+	// Inverse of the decode table, rounded to the nearest byte
+	uint8_t encodeValue(float value, ColorSpace colorSpace) {
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		if (colorSpace == ColorSpace::SRGB) {
+			value = value <= 0.0031308f ? 12.92f * value : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+		}
+		return static_cast<uint8_t>(std::lrint(value * 255.0f));
+	}
+
+	// Source texels one texel of the next mip level covers along one axis, with integer weights that
+	// sum to weightSum. Even sizes halve into 2-texel boxes. An odd size 2n + 1 shrinks to n texels
+	// that each cover 2 + 1/n source texels: 3 taps weighted (n - i, n, i + 1), so every source texel
+	// counts equally and the last row / column is not dropped.
+	struct MipTaps {
+		int first;
+		int count;
+		float weights[3];
+		float weightSum;
+	};
+
+	std::vector<MipTaps> mipTaps(int sourceSize, int size) {
+		std::vector<MipTaps> taps(size);
+		for (int i = 0; i < size; ++i) {
+			if (sourceSize == 1) {
+				taps[i] = MipTaps{0, 1, {1.0f, 0.0f, 0.0f}, 1.0f};
+			} else if (sourceSize % 2 == 0) {
+				taps[i] = MipTaps{2 * i, 2, {1.0f, 1.0f, 0.0f}, 2.0f};
+			} else {
+				float n = static_cast<float>(size);
+				taps[i] = MipTaps{2 * i, 3, {n - i, n, i + 1.0f}, 2.0f * n + 1.0f};
+			}
+		}
+		return taps;
+	}
+
+	const float* decodeTableFor(ColorSpace colorSpace) {
+		static const std::array<float, 256> linear = makeDecodeTable(ColorSpace::Linear);
+		static const std::array<float, 256> srgb = makeDecodeTable(ColorSpace::SRGB);
+		return colorSpace == ColorSpace::SRGB ? srgb.data() : linear.data();
+	}
+}
+
+ColorSpace parseColorSpace(const std::string& name) {
+	if (name == "linear") return ColorSpace::Linear;
+	if (name == "srgb") return ColorSpace::SRGB;
+	throw std::invalid_argument("Unknown color space: " + name);
+}
+
+TextureFilter parseTextureFilter(const std::string& name) {
+	if (name == "nearest") return TextureFilter::Nearest;
+	if (name == "trilinear") return TextureFilter::Trilinear;
+	throw std::invalid_argument("Unknown texture filter: " + name);
+}
+
+TextureLayout parseTextureLayout(const std::string& name) {
+	if (name == "rowmajor") return TextureLayout::RowMajor;
+	if (name == "tiled") return TextureLayout::Tiled;
+	if (name == "bc1") return TextureLayout::BC1;
+	throw std::invalid_argument("Unknown texture layout: " + name);
+}
+
+std::string textureLayoutName(TextureLayout layout) {
+	if (layout == TextureLayout::BC1) return "bc1";
+	return layout == TextureLayout::Tiled ? "tiled" : "rowmajor";
+}
+
+
+Texture::Texture() : decodeTable(decodeTableFor(ColorSpace::Linear)) {}
+
+Texture::Texture(int width, int height, ColorSpace colorSpace, std::vector<MipLevel> levels,
+				 std::shared_ptr<const PagedTexels> paged)
+		: levels(std::move(levels)), width(width), height(height), colorSpace(colorSpace),
+		  decodeTable(decodeTableFor(colorSpace)), paged(std::move(paged)) {}
+
+Texture::Texture(const std::string& filename, ColorSpace colorSpace, TextureLayout textureLayout)
+		: colorSpace(colorSpace), decodeTable(decodeTableFor(colorSpace)) {
+	std::unique_ptr<MappedFile> file;
+	try {
+		file = std::make_unique<MappedFile>(filename);
+	} catch (const std::runtime_error&) {
+		throw std::runtime_error("Failed to open texture file: " + filename);
+	}
+	const uint8_t* data = file->data();
+	size_t size = file->size();
+	if (size >= sizeof(compressedMagic) && std::memcmp(data, compressedMagic, sizeof(compressedMagic)) == 0) {
+		loadCompressed(data, size, filename);
+		return;
+	}
+
+	PNMHeader header;
+	if (!parsePNMHeader(data, size, header)) {
+		throw std::runtime_error("Not a PNM texture: " + filename);
+	}
+	size_t channels = header.channels();
+	uint32_t maxValue = static_cast<uint32_t>(header.maxValue);
+	if (!header.isASCII() && size - header.dataOffset < header.rowBytes() * header.height) {
+		throw std::runtime_error("Truncated texture file: " + filename);
+	}
+
+	width = header.width;
+	height = header.height;
+	texels.resize(static_cast<size_t>(width) * height * 4);
+
+	if (header.isASCII()) {
+		// Plain formats: numbers have no fixed width, so this is one serial scan
+		size_t pos = header.dataOffset - 1;
+		for (size_t texel = 0; texel < static_cast<size_t>(width) * height; ++texel) {
+			uint8_t* out = texels.data() + texel * 4;
+			for (size_t channel = 0; channel < channels; ++channel) {
+				int sample;
+				if (!readPNMNumber(data, size, pos, sample)) {
+					throw std::runtime_error("Truncated texture file: " + filename);
+				}
+				out[channel] = pnmSampleToByte(static_cast<uint32_t>(sample), maxValue);
+			}
+			if (channels == 1) out[1] = out[2] = out[0];
+			out[3] = 255;
+		}
+		buildMipChain();
+		applyLayout(textureLayout);
+		return;
+	}
+
+	// Binary formats: every row is at a known offset, convert them all in parallel
+	const uint8_t* payload = data + header.dataOffset;
+	#pragma omp parallel
+	{
+		std::vector<uint8_t> scratch(static_cast<size_t>(width) * channels);
+		#pragma omp for schedule(static)
+		for (int y = 0; y < height; ++y) {
+			pnmRowToRGBA8(payload + static_cast<size_t>(y) * header.rowBytes(), scratch.data(),
+						  texels.data() + static_cast<size_t>(y) * width * 4, header);
+		}
+	}
+	buildMipChain();
+	applyLayout(textureLayout);
+}
+
+void Texture::buildMipChain() {
+	levels.assign(1, MipLevel{width, height, 0, 0});
+	size_t total = static_cast<size_t>(width) * height * 4;
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		const MipLevel& previous = levels.back();
+		MipLevel level{std::max(previous.width / 2, 1), std::max(previous.height / 2, 1), total, 0};
+		total += static_cast<size_t>(level.width) * level.height * 4;
+		levels.push_back(level);
+	}
+	texels.resize(total);
+
+	// Each level is a box filter of the one before, averaged as decoded values (see mipTaps)
+	for (size_t index = 1; index < levels.size(); ++index) {
+		const MipLevel source = levels[index - 1];
+		const MipLevel level = levels[index];
+		std::vector<MipTaps> columns = mipTaps(source.width, level.width);
+		std::vector<MipTaps> rows = mipTaps(source.height, level.height);
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < level.height; ++y) {
+			const MipTaps& row = rows[y];
+			uint8_t* out = texels.data() + level.offset + static_cast<size_t>(y) * level.width * 4;
+			for (int x = 0; x < level.width; ++x, out += 4) {
+				const MipTaps& column = columns[x];
+				float scale = 1.0f / (row.weightSum * column.weightSum);
+				for (int channel = 0; channel < 3; ++channel) {
+					float sum = 0.0f;
+					for (int ty = 0; ty < row.count; ++ty) {
+						const uint8_t* in = texels.data() + source.offset +
+											(static_cast<size_t>(row.first + ty) * source.width + column.first) * 4;
+						for (int tx = 0; tx < column.count; ++tx) {
+							sum += decodeTable[in[tx * 4 + channel]] * (row.weights[ty] * column.weights[tx]);
+						}
+					}
+					out[channel] = encodeValue(sum * scale, colorSpace);
+				}
+				out[3] = 255;
+			}
+		}
+	}
+}
+
+void Texture::applyLayout(TextureLayout newLayout) {
+	if (newLayout == TextureLayout::RowMajor) {
+		return;
+	}
+	if (newLayout == TextureLayout::BC1) {
+		compressBlocks();
+		return;
+	}
+
+	std::vector<MipLevel> tiledLevels = levels;
+	size_t total = 0;
+	for (MipLevel& level : tiledLevels) {
+		level.offset = total;
+		level.blocksX = (level.width + 7) / 8;
+		total += static_cast<size_t>(level.blocksX) * ((level.height + 7) / 8) * 64 * 4;
+	}
+	std::vector<uint8_t> tiled(total, 0);
+
+	for (size_t index = 0; index < levels.size(); ++index) {
+		const MipLevel& source = levels[index];
+		const MipLevel& target = tiledLevels[index];
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < source.height; ++y) {
+			const uint8_t* in = texels.data() + source.offset + static_cast<size_t>(y) * source.width * 4;
+			for (int x0 = 0; x0 < source.width; x0 += 8) {
+				// one 8-texel run of the row is one row of a block
+				size_t block = static_cast<size_t>(y >> 3) * target.blocksX + (x0 >> 3);
+				uint8_t* out = tiled.data() + target.offset + (block * 64 + ((y & 7) << 3)) * 4;
+				std::memcpy(out, in + static_cast<size_t>(x0) * 4, static_cast<size_t>(std::min(8, source.width - x0)) * 4);
+			}
+		}
+	}
+
+	texels.swap(tiled);
+	levels.swap(tiledLevels);
+	layout = newLayout;
+}
+
+void Texture::compressBlocks() {
+	std::vector<MipLevel> blockLevels = levels;
+	size_t total = 0;
+	for (MipLevel& level : blockLevels) {
+		level.offset = total;
+		level.blocksX = (level.width + 3) / 4;
+		total += static_cast<size_t>(level.blocksX) * ((level.height + 3) / 4) * BC1::blockBytes;
+	}
+	std::vector<uint8_t> blocks(total);
+
+	for (size_t index = 0; index < levels.size(); ++index) {
+		const MipLevel& source = levels[index];
+		const MipLevel& target = blockLevels[index];
+		int blocksY = (source.height + 3) / 4;
+		#pragma omp parallel for schedule(dynamic, 4)
+		for (int blockY = 0; blockY < blocksY; ++blockY) {
+			uint8_t rgba[16 * 4];
+			for (int blockX = 0; blockX < target.blocksX; ++blockX) {
+				// Blocks over the edge repeat the last row / column, so padding never skews the endpoints
+				for (int y = 0; y < 4; ++y) {
+					for (int x = 0; x < 4; ++x) {
+						int sourceX = std::min(blockX * 4 + x, source.width - 1);
+						int sourceY = std::min(blockY * 4 + y, source.height - 1);
+						std::memcpy(rgba + (y * 4 + x) * 4, texelAt(source, sourceX, sourceY), 4);
+					}
+				}
+				size_t block = static_cast<size_t>(blockY) * target.blocksX + blockX;
+				BC1::encodeBlock(rgba, blocks.data() + target.offset + block * BC1::blockBytes);
+			}
+		}
+	}
+
+	texels.swap(blocks);
+	levels.swap(blockLevels);
+	layout = TextureLayout::BC1;
+}
+
+// File: magic, uint32 width, height, level count and color space, uint32 width and height per level, then the blocks
+bool Texture::writeCompressed(const std::string& filename) const {
+	if (layout != TextureLayout::BC1 || paged) return false;
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) return false;
+	uint32_t header[4] = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(levels.size()),
+						  colorSpace == ColorSpace::SRGB ? 1u : 0u};
+	file.write(compressedMagic, sizeof(compressedMagic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	for (const MipLevel& level : levels) {
+		uint32_t size[2] = {static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height)};
+		file.write(reinterpret_cast<const char*>(size), sizeof(size));
+	}
+	file.write(reinterpret_cast<const char*>(texels.data()), static_cast<std::streamsize>(texels.size()));
+	return static_cast<bool>(file);
+}
+
+void Texture::loadCompressed(const uint8_t* data, size_t size, const std::string& filename) {
+	uint32_t header[4];
+	size_t pos = sizeof(compressedMagic);
+	if (size < pos + sizeof(header)) {
+		throw std::runtime_error("Truncated texture file: " + filename);
+	}
+	std::memcpy(header, data + pos, sizeof(header));
+	pos += sizeof(header);
+	if (header[0] == 0 || header[1] == 0 || header[2] == 0 || header[2] > 32 || header[3] > 1 || size < pos + header[2] * 8) {
+		throw std::runtime_error("Not a compressed texture: " + filename);
+	}
+	width = static_cast<int>(header[0]);
+	height = static_cast<int>(header[1]);
+	// The bytes were compressed for this color space: it wins over the one asked for
+	colorSpace = header[3] == 1 ? ColorSpace::SRGB : ColorSpace::Linear;
+	decodeTable = decodeTableFor(colorSpace);
+
+	// Every level must be non-empty (texel lookups wrap with % size) and no larger than the one before,
+	// and together their blocks must fill the rest of the file exactly
+	size_t total = 0;
+	size_t available = size - pos - header[2] * 8;
+	uint32_t previous[2] = {header[0], header[1]};
+	for (uint32_t index = 0; index < header[2]; ++index, pos += 8) {
+		uint32_t levelSize[2];
+		std::memcpy(levelSize, data + pos, sizeof(levelSize));
+		if (levelSize[0] == 0 || levelSize[1] == 0 || levelSize[0] > previous[0] || levelSize[1] > previous[1] ||
+			(index == 0 && (levelSize[0] != header[0] || levelSize[1] != header[1]))) {
+			throw std::runtime_error("Corrupt compressed texture (level " + std::to_string(index) + " is " +
+									 std::to_string(levelSize[0]) + "x" + std::to_string(levelSize[1]) + "): " + filename);
+		}
+		previous[0] = levelSize[0];
+		previous[1] = levelSize[1];
+		MipLevel level{static_cast<int>(levelSize[0]), static_cast<int>(levelSize[1]), total,
+					   static_cast<int>((levelSize[0] + 3) / 4)};
+		uint64_t levelBytes = static_cast<uint64_t>(level.blocksX) * ((levelSize[1] + 3) / 4) * BC1::blockBytes;
+		if (levelBytes > available - total) {
+			throw std::runtime_error("Truncated texture file: " + filename);
+		}
+		total += static_cast<size_t>(levelBytes);
+		levels.push_back(level);
+	}
+	if (total != available) {
+		throw std::runtime_error("Corrupt compressed texture (" + std::to_string(available - total) + " trailing bytes): " + filename);
+	}
+	texels.assign(data + pos, data + pos + total);
+	layout = TextureLayout::BC1;
+}
+
+Color Texture::compressedTexel(const MipLevel& level, int x, int y) const {
+	size_t block = static_cast<size_t>(y >> 2) * level.blocksX + (x >> 2);
+	uint8_t rgb[3];
+	BC1::decodeTexel(texels.data() + level.offset + block * BC1::blockBytes, x & 3, y & 3, rgb);
+	return Color(decodeTable[rgb[0]], decodeTable[rgb[1]], decodeTable[rgb[2]]);
+}
+
+void Texture::copyTexel(const MipLevel& level, int x, int y, uint8_t* rgba) const {
+	if (layout == TextureLayout::BC1) {
+		size_t block = static_cast<size_t>(y >> 2) * level.blocksX + (x >> 2);
+		BC1::decodeTexel(texels.data() + level.offset + block * BC1::blockBytes, x & 3, y & 3, rgba);
+		rgba[3] = 255;
+	} else {
+		std::memcpy(rgba, texelAt(level, x, y), 4);
+	}
+}
+
+Color Texture::fetch(const MipLevel& level, int x, int y) const {
+	x %= level.width;
+	y %= level.height;
+	if (x < 0) x += level.width;
+	if (y < 0) y += level.height;
+	if (paged) return pagedTexel(static_cast<size_t>(&level - levels.data()), x, y);
+	if (layout == TextureLayout::BC1) return compressedTexel(level, x, y);
+	const uint8_t* texel = texelAt(level, x, y);
+	return Color(decodeTable[texel[0]], decodeTable[texel[1]], decodeTable[texel[2]]);
+}
+
+Color Texture::pagedTexel(size_t level, int x, int y) const {
+	uint8_t texel[4];
+	paged->texel(static_cast<int>(level), x, y, texel);
+	return Color(decodeTable[texel[0]], decodeTable[texel[1]], decodeTable[texel[2]]);
+}
+
+Color Texture::pagedBilinear(const MipLevel& level, int ix, int iy, float fx, float fy) const {
+	// Wrap like fetch(), then read all four texels under one pin per tile
+	auto wrap = [](int i, int size) { i %= size; return i < 0 ? i + size : i; };
+	int x0 = wrap(ix, level.width), x1 = wrap(ix + 1, level.width);
+	int y0 = wrap(iy, level.height), y1 = wrap(iy + 1, level.height);
+	uint8_t quad[16];
+	paged->footprint(static_cast<int>(&level - levels.data()), x0, y0, x1, y1, quad);
+	Color corners[4];
+	for (int i = 0; i < 4; ++i) {
+		const uint8_t* texel = quad + i * 4;
+		corners[i] = Color(decodeTable[texel[0]], decodeTable[texel[1]], decodeTable[texel[2]]);
+	}
+	Color top = corners[0] * (1.0f - fx) + corners[1] * fx;
+	Color bottom = corners[2] * (1.0f - fx) + corners[3] * fx;
+	return top * (1.0f - fy) + bottom * fy;
+}
+
+Color Texture::bilinear(const MipLevel& level, float u, float v) const {
+	// texel centers sit at (i + 0.5) / size
+	float x = u * level.width - 0.5f;
+	float y = v * level.height - 0.5f;
+	float x0 = std::floor(x), y0 = std::floor(y);
+	float fx = x - x0, fy = y - y0;
+	int ix = static_cast<int>(x0), iy = static_cast<int>(y0);
+	if (paged) return pagedBilinear(level, ix, iy, fx, fy);
+	Color top = fetch(level, ix, iy) * (1.0f - fx) + fetch(level, ix + 1, iy) * fx;
+	Color bottom = fetch(level, ix, iy + 1) * (1.0f - fx) + fetch(level, ix + 1, iy + 1) * fx;
+	return top * (1.0f - fy) + bottom * fy;
+}
+
+Color Texture::sample(float u, float v, float footprint) const {
+	if (footprint <= 0.0f) {
+		int texX = static_cast<int>(u * width) % width;
+		int texY = static_cast<int>(v * height) % height;
+		return getTexel(texX, texY);
+	}
+	if (!std::isfinite(u) || !std::isfinite(v)) {
+		return fetch(levels[0], 0, 0);
+	}
+	u -= std::floor(u);
+	v -= std::floor(v);
+
+	// Level whose texels are about as wide as the footprint
+	float lod = std::log2(footprint * static_cast<float>(std::max(width, height)));
+	lod = std::min(std::max(lod, 0.0f), static_cast<float>(levels.size() - 1));
+	size_t level = static_cast<size_t>(lod);
+	float blend = lod - static_cast<float>(level);
+	Color color = bilinear(levels[level], u, v);
+	if (blend > 0.0f && level + 1 < levels.size()) {
+		color = color * (1.0f - blend) + bilinear(levels[level + 1], u, v) * blend;
+	}
+	return color;
+}
+
+int Texture::getWidth() const { return width; }
+int Texture::getHeight() const { return height; }
+int Texture::getNumLevels() const { return static_cast<int>(levels.size()); }
+ColorSpace Texture::getColorSpace() const { return colorSpace; }
+TextureLayout Texture::getLayout() const { return layout; }
+size_t Texture::getByteSize() const { return texels.size(); }
@@ -0,0 +1,125 @@
+#ifndef RAYTRACER_TEXTURE_H
+#define RAYTRACER_TEXTURE_H
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Color.h"
+
+/* How the 8-bit values of a texture file are turned into shading values */
+enum class ColorSpace {
+	Linear,	// byte / 255, what textures always did
+	SRGB	// decoded through the sRGB curve: painted / photographed textures
+};
+
+ColorSpace parseColorSpace(const std::string& name);	// "linear" or "srgb"
+
+enum class TextureFilter {
+	Nearest,	// one texel of the full-size level, what textures always did
+	Trilinear	// mip level picked from the ray cone footprint, bilinear within and between levels
+};
+
+TextureFilter parseTextureFilter(const std::string& name);	// "nearest" or "trilinear"
+
+/* Where texel (x, y) of a level lives in memory */
+enum class TextureLayout {
+	RowMajor,	// row after row: vertical neighbours are a whole row apart
+	Tiled,	// 8x8 blocks of 256 bytes, row-major inside: a bilinear footprint stays within one or two blocks
+	BC1	// 4x4 blocks compressed to 8 bytes (see BlockCompression.h): an eighth of the memory, lossy
+};
+
+TextureLayout parseTextureLayout(const std::string& name);	// "rowmajor", "tiled" or "bc1"
+std::string textureLayoutName(TextureLayout layout);
+
+class PagedTexels;
+
+
+/*
+ * Image texture kept as it came from the file: 8 bits per channel, RGBA so every texel is one
+ * aligned 4-byte load (a quarter of the float Color the framebuffer Image stores).
+ * Texels are decoded when sampled, through a 256-entry table per color space.
+ * The mip chain (each level half the size of the one before, down to 1x1) is built at load time.
+ * Textures opened through a TextureCache keep no texels in memory and page tiles in instead.
+ */
+class Texture {
+	private:
+		friend class TextureCache;
+
+		struct MipLevel {
+			int width;
+			int height;
+			size_t offset;	// of the first texel in texels
+			int blocksX;	// Tiled / BC1: blocks per block row (the level is padded to whole blocks)
+		};
+
+		std::vector<uint8_t> texels;	// RGBA8 in layout (or BC1 blocks), level after level, alpha always 255
+		std::vector<MipLevel> levels;
+		TextureLayout layout = TextureLayout::RowMajor;
+		int width = 0;
+		int height = 0;
+		ColorSpace colorSpace = ColorSpace::Linear;
+		const float* decodeTable = nullptr;	// byte -> value in colorSpace
+		std::shared_ptr<const PagedTexels> paged;	// set when the texels live in a tile file instead
+
+		// Paged texture: level sizes only
+		Texture(int width, int height, ColorSpace colorSpace, std::vector<MipLevel> levels,
+				std::shared_ptr<const PagedTexels> paged);
+
+		void buildMipChain();	// from a row-major level 0; rows of each level in parallel
+		void applyLayout(TextureLayout newLayout);	// re-packs every level of a row-major texture
+		void compressBlocks();	// applyLayout(BC1): every level of a row-major texture, block rows in parallel
+		void loadCompressed(const uint8_t* data, size_t size, const std::string& filename);
+
+		// Where an uncompressed layout keeps texel (x, y)
+		const uint8_t* texelAt(const MipLevel& level, int x, int y) const {
+			if (layout == TextureLayout::RowMajor) {
+				return texels.data() + level.offset + (static_cast<size_t>(y) * level.width + x) * 4;
+			}
+			size_t block = static_cast<size_t>(y >> 3) * level.blocksX + (x >> 3);
+			return texels.data() + level.offset + (block * 64 + ((y & 7) << 3) + (x & 7)) * 4;
+		}
+		Color fetch(const MipLevel& level, int x, int y) const;	// wraps around
+		Color pagedTexel(size_t level, int x, int y) const;
+		Color compressedTexel(const MipLevel& level, int x, int y) const;
+		void copyTexel(const MipLevel& level, int x, int y, uint8_t* rgba) const;	// any layout held in memory
+		Color bilinear(const MipLevel& level, float u, float v) const;
+		Color pagedBilinear(const MipLevel& level, int ix, int iy, float fx, float fy) const;	// bilinear() of a paged texture
+
+	public:
+		Texture();
+		// PNM file: P6 / P5 or ASCII P3 / P2 (see PNM.h). Texels are 8-bit, so 16-bit files
+		// (maxval > 255) are accepted but rounded to the nearest 8-bit value: their extra precision is lost.
+		// Memory-mapped and converted row by row in parallel. Files saved by writeCompressed() load as
+		// they are, in the BC1 layout and the color space they were compressed for, whatever is asked for. Throws std::runtime_error on failure.
+		explicit Texture(const std::string& filename, ColorSpace colorSpace = ColorSpace::Linear,
+						 TextureLayout layout = TextureLayout::Tiled);
+
+		int getWidth() const;
+		int getHeight() const;
+		ColorSpace getColorSpace() const;
+		TextureLayout getLayout() const;
+		int getNumLevels() const;
+		size_t getByteSize() const;	// all levels held in memory (none when paged)
+
+		// Saves a BC1 texture with its mip chain and color space, so later loads skip compression; false on failure
+		bool writeCompressed(const std::string& filename) const;
+
+		// Color at texture coordinates (u, v), repeating outside [0, 1). footprint is the width the
+		// sample covers, in the same units (1 = the whole texture); 0 picks the nearest full-size texel.
+		Color sample(float u, float v, float footprint) const;
+
+		// Level 0 texel. Inline: one of these per nearest-filtered hit
+		Color getTexel(int x, int y) const {
+			if (x < 0 || x >= width || y < 0 || y >= height) {
+				throw std::out_of_range("Texel coordinates out of bounds");
+			}
+			if (paged) return pagedTexel(0, x, y);
+			if (layout == TextureLayout::BC1) return compressedTexel(levels[0], x, y);
+			const uint8_t* texel = texelAt(levels[0], x, y);
+			return Color(decodeTable[texel[0]], decodeTable[texel[1]], decodeTable[texel[2]]);
+		}
+};
+
+
+#endif //RAYTRACER_TEXTURE_H
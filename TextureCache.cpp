@@ -0,0 +1,359 @@
+#include "TextureCache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define RAYTRACER_HAS_PREAD 1
+#endif
+
+namespace {
+	const char tileFileMagic[8] = {'R', 'T', 'T', 'I', 'L', 'E', 'S', '2'};
+
+	long processId() {
+#ifdef RAYTRACER_HAS_PREAD
+		return static_cast<long>(getpid());
+#else
+		return 0;	// the random part of the name still keeps writers apart
+#endif
+	}
+
+	thread_local long long hits = 0;
+	thread_local long long misses = 0;
+
+	struct TileFileHeader {
+		char magic[8];
+		uint32_t width;
+		uint32_t height;
+		uint32_t numLevels;
+		uint32_t tileSize;
+		uint32_t colorSpace;	// 1 for sRGB: a .rtc source decodes as it was compressed, not as asked
+	};
+
+	// False for a missing file or one in an older layout, which is then rebuilt from its source
+	bool hasCurrentMagic(const std::string& tileFile) {
+		std::ifstream file(tileFile, std::ios::binary);
+		char magic[sizeof(tileFileMagic)];
+		file.read(magic, sizeof(magic));
+		return file && std::memcmp(magic, tileFileMagic, sizeof(tileFileMagic)) == 0;
+	}
+
+	size_t tileDataOffset(uint32_t numLevels) {
+		size_t size = sizeof(TileFileHeader) + numLevels * 2 * sizeof(uint32_t);
+		return (size + 4095) / 4096 * 4096;	// tiles start page-aligned
+	}
+
+	bool readAt(const std::string& filename, int fd, size_t offset, uint8_t* out, size_t length) {
+#ifdef RAYTRACER_HAS_PREAD
+		(void)filename;
+		while (length > 0) {
+			ssize_t got = pread(fd, out, length, static_cast<off_t>(offset));
+			if (got <= 0) return false;
+			out += got;
+			offset += static_cast<size_t>(got);
+			length -= static_cast<size_t>(got);
+		}
+		return true;
+#else
+		(void)fd;
+		std::ifstream file(filename, std::ios::binary);
+		file.seekg(static_cast<std::streamoff>(offset));
+		file.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(length));
+		return static_cast<bool>(file);
+#endif
+	}
+}
+
+
+PagedTexels::~PagedTexels() {
+	if (cache) cache->forget(*this);
+#ifdef RAYTRACER_HAS_PREAD
+	if (fd >= 0) close(fd);
+#endif
+}
+
+size_t PagedTexels::tileOf(int level, int x, int y) const {
+	const LevelTiles& tiles = levels[level];
+	return tiles.firstTile + static_cast<size_t>(y / tileSize) * tiles.tilesX + x / tileSize;
+}
+
+const uint8_t* PagedTexels::pin(size_t tile) const {
+	Slot& slot = slots[tile];
+	bool missed = false;
+	for (;;) {
+		// Pin before looking: an evictor that swapped the pointer out then sees the pin and defers the free
+		slot.pins.fetch_add(1);
+		if (const uint8_t* data = slot.data.load()) {
+			if (!slot.referenced.load(std::memory_order_relaxed)) slot.referenced.store(true, std::memory_order_relaxed);
+			if (missed) ++misses;
+			else ++hits;
+			return data;
+		}
+		slot.pins.fetch_sub(1);
+		missed = true;
+
+		bool expected = false;
+		if (slot.loading.compare_exchange_strong(expected, true)) {
+			if (!slot.data.load()) loadTile(slot, tile);
+			slot.loading.store(false);
+		} else {
+			std::this_thread::yield();	// another thread is reading this tile
+		}
+	}
+}
+
+void PagedTexels::unpin(size_t tile) const { slots[tile].pins.fetch_sub(1); }
+
+void PagedTexels::texel(int level, int x, int y, uint8_t* out) const {
+	size_t tile = tileOf(level, x, y);
+	std::memcpy(out, pin(tile) + (static_cast<size_t>(y % tileSize) * tileSize + x % tileSize) * 4, 4);
+	unpin(tile);
+}
+
+void PagedTexels::footprint(int level, int x0, int y0, int x1, int y1, uint8_t* out) const {
+	const int xs[4] = {x0, x1, x0, x1};
+	const int ys[4] = {y0, y0, y1, y1};
+	// Usually all four texels share one tile; they span up to four at tile edges (and on wrap-around).
+	// Every tile stays pinned until all four are copied: loading a later one may evict an earlier
+	// one, but a pinned tile is only retired, never freed
+	size_t tiles[4];
+	const uint8_t* data[4];
+	int numTiles = 0;
+	for (int i = 0; i < 4; ++i) {
+		size_t tile = tileOf(level, xs[i], ys[i]);
+		int known = 0;
+		while (known < numTiles && tiles[known] != tile) ++known;
+		if (known == numTiles) {
+			tiles[numTiles] = tile;
+			data[numTiles++] = pin(tile);
+		}
+		std::memcpy(out + i * 4, data[known] + (static_cast<size_t>(ys[i] % tileSize) * tileSize + xs[i] % tileSize) * 4, 4);
+	}
+	for (int i = 0; i < numTiles; ++i) unpin(tiles[i]);
+}
+
+void PagedTexels::loadTile(Slot& slot, size_t tile) const {
+	{
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->reserve();
+	}
+	uint8_t* data = new uint8_t[tileBytes];
+	if (!readAt(filename, fd, dataOffset + tile * tileBytes, data, tileBytes)) {
+		std::memset(data, 0, tileBytes);	// unreadable: black rather than a crash mid-render
+	}
+	++cache->tileLoads;
+	slot.referenced.store(true, std::memory_order_relaxed);
+	slot.data.store(data);
+	cache->admit(&slot, data);
+}
+
+
+TextureCache::TextureCache(size_t budgetBytes, const std::string& cacheDirectory)
+		: budgetBytes(std::max(budgetBytes, PagedTexels::tileBytes)), cacheDirectory(cacheDirectory) {}
+
+std::shared_ptr<TextureCache> TextureCache::create(size_t budgetBytes, const std::string& cacheDirectory) {
+	return std::shared_ptr<TextureCache>(new TextureCache(budgetBytes, cacheDirectory));
+}
+
+TextureCache::~TextureCache() {
+	// Every PagedTexels holds the cache, so by now all of them have released their tiles
+	for (auto& entry : retired) delete[] entry.second;
+}
+
+void TextureCache::reserve() {
+	for (;;) {
+		// Free evicted tiles nobody is reading any more (anyone pinning from now on finds the slot empty)
+		for (size_t i = 0; i < retired.size();) {
+			if (retired[i].first->pins.load() == 0) {
+				delete[] retired[i].second;
+				residentBytes -= PagedTexels::tileBytes;
+				retired[i] = retired.back();
+				retired.pop_back();
+			} else {
+				++i;
+			}
+		}
+		if (residentBytes + PagedTexels::tileBytes <= budgetBytes || resident.empty()) break;
+
+		// Run the clock: referenced tiles get a second chance, the first unreferenced one is evicted
+		clockHand %= resident.size();
+		PagedTexels::Slot* slot = resident[clockHand].first;
+		if (slot->referenced.exchange(false, std::memory_order_relaxed)) {
+			++clockHand;
+			continue;
+		}
+		retired.push_back({slot, slot->data.exchange(nullptr)});
+		resident[clockHand] = resident.back();
+		resident.pop_back();
+		++evictions;
+	}
+	residentBytes += PagedTexels::tileBytes;
+}
+
+void TextureCache::admit(PagedTexels::Slot* slot, uint8_t* data) {
+	std::lock_guard<std::mutex> lock(mutex);
+	resident.push_back({slot, data});
+}
+
+void TextureCache::forget(const PagedTexels& texels) {
+	std::lock_guard<std::mutex> lock(mutex);
+	const PagedTexels::Slot* first = texels.slots.get();
+	const PagedTexels::Slot* last = first + texels.numTiles;
+	auto owned = [first, last](const std::pair<PagedTexels::Slot*, uint8_t*>& entry) {
+		return entry.first >= first && entry.first < last;
+	};
+	for (auto* list : {&resident, &retired}) {
+		for (const auto& entry : *list) {
+			if (owned(entry)) {
+				delete[] entry.second;
+				residentBytes -= PagedTexels::tileBytes;
+			}
+		}
+		list->erase(std::remove_if(list->begin(), list->end(), owned), list->end());
+	}
+	clockHand = 0;
+}
+
+std::string TextureCache::tileFileFor(const std::string& path, ColorSpace colorSpace) const {
+	std::filesystem::path source(path);
+	std::string name = source.filename().string() + (colorSpace == ColorSpace::SRGB ? ".srgb.rtt" : ".rtt");
+	std::filesystem::path directory = cacheDirectory.empty() ? source.parent_path() : std::filesystem::path(cacheDirectory);
+	return (directory / name).string();
+}
+
+void TextureCache::writeTileFile(const std::string& path, ColorSpace colorSpace, const std::string& tileFile) const {
+	// The whole chain is built in memory once (decoded, if the source is block-compressed); renders after that only page tiles in
+	Texture texture(path, colorSpace, TextureLayout::RowMajor);
+	const int tileSize = PagedTexels::tileSize;
+
+	TileFileHeader header{};
+	std::memcpy(header.magic, tileFileMagic, sizeof(tileFileMagic));
+	header.width = static_cast<uint32_t>(texture.width);
+	header.height = static_cast<uint32_t>(texture.height);
+	header.numLevels = static_cast<uint32_t>(texture.levels.size());
+	header.tileSize = static_cast<uint32_t>(tileSize);
+	header.colorSpace = texture.getColorSpace() == ColorSpace::SRGB ? 1 : 0;
+
+	// Unique per process and call, so concurrent renders converting the same texture never write into
+	// one file; each renames a complete file into place and the last rename wins
+	std::random_device random;
+	std::string temporary = tileFile + "." + std::to_string(processId()) + "." + std::to_string(random()) + ".tmp";
+	std::ofstream file(temporary, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Could not create texture tile file: " + tileFile);
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const Texture::MipLevel& level : texture.levels) {
+		uint32_t size[2] = {static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height)};
+		file.write(reinterpret_cast<const char*>(size), sizeof(size));
+	}
+	std::vector<char> padding(tileDataOffset(header.numLevels) - static_cast<size_t>(file.tellp()), 0);
+	file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+	// Tiles of a level row by row, texels row by row inside a tile; the edges are padded with black
+	std::vector<uint8_t> tile(PagedTexels::tileBytes);
+	for (const Texture::MipLevel& level : texture.levels) {
+		for (int tileY = 0; tileY < level.height; tileY += tileSize) {
+			for (int tileX = 0; tileX < level.width; tileX += tileSize) {
+				std::fill(tile.begin(), tile.end(), 0);
+				for (int y = tileY; y < std::min(tileY + tileSize, level.height); ++y) {
+					for (int x = tileX; x < std::min(tileX + tileSize, level.width); ++x) {
+						texture.copyTexel(level, x, y, tile.data() + (static_cast<size_t>(y - tileY) * tileSize + x - tileX) * 4);
+					}
+				}
+				file.write(reinterpret_cast<const char*>(tile.data()), static_cast<std::streamsize>(tile.size()));
+			}
+		}
+	}
+	file.close();
+	if (!file) {
+		std::error_code error;
+		std::filesystem::remove(temporary, error);
+		throw std::runtime_error("Could not write texture tile file: " + tileFile);
+	}
+	std::filesystem::rename(temporary, tileFile);	// readers never see a half-written file
+}
+
+std::shared_ptr<const Texture> TextureCache::getTexture(const std::string& path, ColorSpace colorSpace) {
+	std::string tileFile = tileFileFor(path, colorSpace);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = textures.find(tileFile);
+		if (found != textures.end()) {
+			if (std::shared_ptr<const Texture> texture = found->second.lock()) {
+				return texture;
+			}
+		}
+	}
+
+	// A tile file whose source has been removed since is still good: only a newer source replaces it
+	std::error_code tileError, sourceError;
+	auto tileTime = std::filesystem::last_write_time(tileFile, tileError);
+	auto sourceTime = std::filesystem::last_write_time(path, sourceError);
+	if (tileError || (!sourceError && (tileTime < sourceTime || !hasCurrentMagic(tileFile)))) {
+		writeTileFile(path, colorSpace, tileFile);
+	}
+
+	// Only the header is read here
+	std::ifstream file(tileFile, std::ios::binary);
+	TileFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || std::memcmp(header.magic, tileFileMagic, sizeof(tileFileMagic)) != 0 ||
+		header.tileSize != static_cast<uint32_t>(PagedTexels::tileSize) || header.numLevels == 0 || header.colorSpace > 1) {
+		throw std::runtime_error("Not a texture tile file: " + tileFile);
+	}
+
+	auto texels = std::make_shared<PagedTexels>();
+	texels->cache = shared_from_this();
+	texels->filename = tileFile;
+	texels->dataOffset = tileDataOffset(header.numLevels);
+
+	std::vector<Texture::MipLevel> levels;
+	for (uint32_t index = 0; index < header.numLevels; ++index) {
+		uint32_t size[2];
+		file.read(reinterpret_cast<char*>(size), sizeof(size));
+		int tilesX = static_cast<int>((size[0] + PagedTexels::tileSize - 1) / PagedTexels::tileSize);
+		int tilesY = static_cast<int>((size[1] + PagedTexels::tileSize - 1) / PagedTexels::tileSize);
+		levels.push_back(Texture::MipLevel{static_cast<int>(size[0]), static_cast<int>(size[1]), 0, 0});
+		texels->levels.push_back(PagedTexels::LevelTiles{tilesX, texels->numTiles});
+		texels->numTiles += static_cast<size_t>(tilesX) * tilesY;
+	}
+	if (!file) {
+		throw std::runtime_error("Truncated texture tile file: " + tileFile);
+	}
+	texels->slots.reset(new PagedTexels::Slot[texels->numTiles]);
+#ifdef RAYTRACER_HAS_PREAD
+	texels->fd = open(tileFile.c_str(), O_RDONLY);
+	if (texels->fd < 0) {
+		throw std::runtime_error("Could not open texture tile file: " + tileFile);
+	}
+#endif
+	std::shared_ptr<const Texture> texture(new Texture(static_cast<int>(header.width), static_cast<int>(header.height),
+													   header.colorSpace == 1 ? ColorSpace::SRGB : ColorSpace::Linear,
+													   std::move(levels), texels));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// Drop textures every scene has let go of, so a long batch does not accumulate dead entries
+	for (auto entry = textures.begin(); entry != textures.end();) {
+		entry = entry->second.expired() ? textures.erase(entry) : std::next(entry);
+	}
+	textures[tileFile] = texture;
+	return texture;
+}
+
+size_t TextureCache::getBudgetBytes() const { return budgetBytes; }
+size_t TextureCache::getResidentBytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return residentBytes;
+}
+long long TextureCache::getTileLoads() const { return tileLoads; }
+long long TextureCache::getEvictions() const { return evictions; }
+
+long long TextureCache::threadHits() { return hits; }
+long long TextureCache::threadMisses() { return misses; }
@@ -0,0 +1,117 @@
+#ifndef RAYTRACER_TEXTURECACHE_H
+#define RAYTRACER_TEXTURECACHE_H
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Texture.h"
+
+class TextureCache;
+
+/*
+ * Texels of one texture that live in a pre-tiled file instead of memory: every mip level cut
+ * into 64x64 tiles that are read on demand into the owning TextureCache.
+ * Lookups take no lock: a reader pins the tile's slot, and eviction only frees a tile
+ * once nobody holds a pin on it.
+ */
+class PagedTexels {
+	private:
+		friend class TextureCache;
+
+		struct Slot {
+			std::atomic<uint8_t*> data{nullptr};	// the tile's RGBA8 texels while resident
+			std::atomic<int> pins{0};	// readers between loading data and copying their texel
+			std::atomic<bool> referenced{false};	// hit since the clock hand last passed
+			std::atomic<bool> loading{false};
+		};
+
+		struct LevelTiles {
+			int tilesX;
+			size_t firstTile;	// index of the level's first tile in slots and in the file
+		};
+
+		std::shared_ptr<TextureCache> cache;
+		std::string filename;
+		int fd = -1;
+		size_t dataOffset = 0;	// of tile 0 in the file
+		std::vector<LevelTiles> levels;
+		std::unique_ptr<Slot[]> slots;
+		size_t numTiles = 0;
+
+		void loadTile(Slot& slot, size_t tile) const;
+		size_t tileOf(int level, int x, int y) const;
+		// The tile's texels, read from disk on a miss; they stay valid until the matching unpin()
+		const uint8_t* pin(size_t tile) const;
+		void unpin(size_t tile) const;
+
+	public:
+		static const int tileSize = 64;	// texels per side
+		static const size_t tileBytes = tileSize * tileSize * 4;
+
+		~PagedTexels();
+
+		// Copies the 4 bytes of texel (x, y) of level; the tile is read from disk on a miss
+		void texel(int level, int x, int y, uint8_t* out) const;
+		// Copies the 2x2 bilinear footprint (x0, y0), (x1, y0), (x0, y1), (x1, y1) of level into out (16 bytes),
+		// pinning each distinct tile once instead of once per texel
+		void footprint(int level, int x0, int y0, int x1, int y1, uint8_t* out) const;
+};
+
+
+/*
+ * Out-of-core texture storage shared by every texture opened through it, under one memory
+ * budget. Textures are converted once into pre-tiled ".rtt" files next to their source (or
+ * in a cache directory) holding the whole mip chain; after that only the tiles a render
+ * touches are read, and the least recently used ones are evicted when the budget is full
+ * (LRU approximated with the CLOCK algorithm, so hits never take a lock).
+ *
+ * Hit and miss counts are kept per thread; render() reports their difference per frame.
+ */
+class TextureCache : public std::enable_shared_from_this<TextureCache> {
+	private:
+		friend class PagedTexels;
+
+		size_t budgetBytes;
+		std::string cacheDirectory;
+
+		std::mutex mutex;	// residency bookkeeping and the texture map, never taken on a hit
+		std::vector<std::pair<PagedTexels::Slot*, uint8_t*>> resident;	// clock ring of loaded tiles
+		size_t clockHand = 0;
+		std::vector<std::pair<PagedTexels::Slot*, uint8_t*>> retired;	// evicted but still pinned
+		size_t residentBytes = 0;
+		std::map<std::string, std::weak_ptr<const Texture>> textures;	// by tile file; expired entries are erased on insert
+		std::atomic<long long> tileLoads{0};
+		std::atomic<long long> evictions{0};
+
+		TextureCache(size_t budgetBytes, const std::string& cacheDirectory);
+		std::string tileFileFor(const std::string& path, ColorSpace colorSpace) const;
+		void writeTileFile(const std::string& path, ColorSpace colorSpace, const std::string& tileFile) const;
+		void reserve();	// room for one more tile, evicting while over budget; mutex held
+		void admit(PagedTexels::Slot* slot, uint8_t* data);
+		void forget(const PagedTexels& texels);	// drops the texels' tiles before they go away
+
+	public:
+		// budgetBytes caps the tiles held in memory; an empty cacheDirectory puts tile files next to the textures
+		static std::shared_ptr<TextureCache> create(size_t budgetBytes, const std::string& cacheDirectory = "");
+		~TextureCache();
+		TextureCache(const TextureCache&) = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+
+		// Paged texture for the file; builds its tile file first if missing or older than the source
+		std::shared_ptr<const Texture> getTexture(const std::string& path, ColorSpace colorSpace = ColorSpace::Linear);
+
+		size_t getBudgetBytes() const;
+		size_t getResidentBytes();
+		long long getTileLoads() const;
+		long long getEvictions() const;
+
+		// Tile lookups (one per texel or filter footprint) by the calling thread so far, found in memory / read from disk
+		static long long threadHits();
+		static long long threadMisses();
+};
+
+
+#endif //RAYTRACER_TEXTURECACHE_H
@@ -0,0 +1,93 @@
+#include "TileOrder.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+	// Gathers every other bit of v (bits 0, 2, 4, ...) into the low 32 bits: inverse of interleaving
+	uint64_t compactBits(uint64_t v) {
+		v &= 0x5555555555555555ull;
+		v = (v | (v >> 1)) & 0x3333333333333333ull;
+		v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+		v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+		v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+		v = (v | (v >> 16)) & 0x00000000ffffffffull;
+		return v;
+	}
+
+	void mortonCell(uint64_t d, uint64_t& x, uint64_t& y) {
+		x = compactBits(d);
+		y = compactBits(d >> 1);
+	}
+
+	// Cell at distance d along the Hilbert curve filling an n x n grid (n a power of two)
+	void hilbertCell(uint64_t n, uint64_t d, uint64_t& x, uint64_t& y) {
+		x = 0;
+		y = 0;
+		for (uint64_t s = 1; s < n; s *= 2) {
+			uint64_t rx = 1 & (d / 2);
+			uint64_t ry = 1 & (d ^ rx);
+			// rotate the quadrant so the sub-curve has the right orientation
+			if (ry == 0) {
+				if (rx == 1) {
+					x = s - 1 - x;
+					y = s - 1 - y;
+				}
+				std::swap(x, y);
+			}
+			x += s * rx;
+			y += s * ry;
+			d /= 4;
+		}
+	}
+}
+
+TileOrder parseTileOrder(const std::string& name) {
+	if (name == "rowmajor") return TileOrder::RowMajor;
+	if (name == "morton") return TileOrder::Morton;
+	if (name == "hilbert") return TileOrder::Hilbert;
+	throw std::invalid_argument("Unknown tile order: " + name);
+}
+
+std::string tileOrderName(TileOrder order) {
+	switch (order) {
+		case TileOrder::Morton: return "morton";
+		case TileOrder::Hilbert: return "hilbert";
+		default: return "rowmajor";
+	}
+}
+
+TraversalOrder::TraversalOrder(int columns, int rows, TileOrder order) : columns(columns), rows(rows), order(order) {
+	wide = columns >= rows;
+	while (side < static_cast<uint64_t>(std::max(1, std::min(columns, rows)))) side *= 2;
+}
+
+uint64_t TraversalOrder::size() const {
+	uint64_t cells = static_cast<uint64_t>(columns) * rows;
+	if (order == TileOrder::RowMajor || cells == 0) return cells;
+	uint64_t length = static_cast<uint64_t>(wide ? columns : rows);
+	return (length + side - 1) / side * side * side;
+}
+
+int TraversalOrder::cellAt(uint64_t position) const {
+	if (order == TileOrder::RowMajor) return static_cast<int>(position);
+
+	uint64_t square = position / (side * side);
+	uint64_t x, y;
+	if (order == TileOrder::Morton) mortonCell(position % (side * side), x, y);
+	else hilbertCell(side, position % (side * side), x, y);
+	(wide ? x : y) += square * side;
+	if (x >= static_cast<uint64_t>(columns) || y >= static_cast<uint64_t>(rows)) return -1;
+	return static_cast<int>(y * columns + x);
+}
+
+std::vector<int> makeTraversalOrder(int columns, int rows, TileOrder order) {
+	TraversalOrder traversal(columns, rows, order);
+	std::vector<int> cells;
+	cells.reserve(static_cast<size_t>(columns) * rows);
+	for (uint64_t position = 0; position < traversal.size(); ++position) {
+		int cell = traversal.cellAt(position);
+		if (cell >= 0) cells.push_back(cell);
+	}
+	return cells;
+}
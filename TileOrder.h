@@ -0,0 +1,46 @@
+#ifndef RAYTRACER_TILEORDER_H
+#define RAYTRACER_TILEORDER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Order in which tiles are handed to threads and pixels are visited inside a tile.
+ * Space-filling curves keep consecutive work close together on screen, so threads
+ * running at the same time touch the same shapes and texels in the shared cache.
+ */
+enum class TileOrder {
+	RowMajor,
+	Morton,		// Z-order: interleaved x/y bits
+	Hilbert		// no jumps between consecutive cells
+};
+
+TileOrder parseTileOrder(const std::string& name);	// "rowmajor", "morton" or "hilbert"
+std::string tileOrderName(TileOrder order);
+
+/*
+ * Traversal order of a columns x rows grid, computed from the position in the order on demand:
+ * it takes no memory however many cells the grid has.
+ * Curves are defined on power-of-two squares, so the grid is covered by a line of such squares
+ * along its longer side; positions that fall outside the grid are skipped (cellAt returns -1).
+ */
+class TraversalOrder {
+	private:
+		int columns;
+		int rows;
+		TileOrder order;
+		uint64_t side = 1;	// of each curve square
+		bool wide = true;	// squares laid out along x (else along y)
+
+	public:
+		TraversalOrder(int columns, int rows, TileOrder order);
+
+		uint64_t size() const;	// number of positions: every cell, plus the skipped ones for curves
+		int cellAt(uint64_t position) const;	// y * columns + x of the cell at position, -1 if skipped
+};
+
+// Indices (y * columns + x) of every cell of a columns x rows grid, in traversal order
+std::vector<int> makeTraversalOrder(int columns, int rows, TileOrder order);
+
+
+#endif //RAYTRACER_TILEORDER_H
@@ -0,0 +1,60 @@
+#include "ToneMap.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+Color toneMapLinear(Color radiance, float exposure) {
+	Color color = radiance * exposure; //TODO: What if exposure is too low
+	float maxIntensity = std::max(color.getR(), std::max(color.getG(), color.getB()));
+	if (maxIntensity > 1.0f) {
+		color = color.linearToneMap(maxIntensity);
+	}
+	return color;
+}
+
+void toneMapImage(const Image& radiance, Image& output, float exposure) {
+	if (radiance.getWidth() != output.getWidth() || radiance.getHeight() != output.getHeight()) {
+		throw std::invalid_argument("toneMapImage: radiance and output sizes differ");
+	}
+	int width = radiance.getWidth();
+	int height = radiance.getHeight();
+
+	#pragma omp parallel
+	{
+		std::vector<float> row(static_cast<size_t>(width) * 3);
+		#pragma omp for schedule(static)
+		for (int y = 0; y < height; ++y) {
+			radiance.decodeRow(y, row.data());
+			for (int x = 0; x < width; ++x) {
+				float* pixel = row.data() + 3 * x;
+				Color color = toneMapLinear(Color(pixel[0], pixel[1], pixel[2]), exposure);
+				pixel[0] = color.getR();
+				pixel[1] = color.getG();
+				pixel[2] = color.getB();
+			}
+			output.encodeRow(y, row.data());
+		}
+	}
+}
+
+bool writeExposure(const std::string& pfmFilename, float exposure) {
+	std::ofstream file(pfmFilename + ".exposure");
+	if (!file) {
+		return false;
+	}
+	file.precision(std::numeric_limits<float>::max_digits10);	// reads back to the same float
+	file << exposure << "\n";
+	return file.good();
+}
+
+bool readExposure(const std::string& pfmFilename, float& exposure) {
+	std::ifstream file(pfmFilename + ".exposure");
+	float value;
+	if (!(file >> value)) {
+		return false;
+	}
+	exposure = value;
+	return true;
+}
@@ -0,0 +1,23 @@
+#ifndef RAYTRACER_TONEMAP_H
+#define RAYTRACER_TONEMAP_H
+#include <string>
+#include "Color.h"
+#include "Image.h"
+
+// Exposure, then linear tone mapping: a pixel brighter than 1 is scaled down by its brightest channel
+Color toneMapLinear(Color radiance, float exposure);
+
+/*
+ * Tone maps a whole radiance image (e.g. render()'s HDR buffer or a loaded PFM) into output,
+ * which must have the same size. Rows run in parallel; no ray is traced, so changing the
+ * exposure of a finished frame takes milliseconds instead of a re-render.
+ */
+void toneMapImage(const Image& radiance, Image& output, float exposure);
+
+// The exposure a radiance PFM was rendered with, kept next to it in <file>.exposure so
+// re-tone mapping reproduces the original frame unless another exposure is asked for
+bool writeExposure(const std::string& pfmFilename, float exposure);
+bool readExposure(const std::string& pfmFilename, float& exposure);	// false if none was recorded
+
+
+#endif //RAYTRACER_TONEMAP_H
@@ -7,9 +7,68 @@
 #include "Vector3.h"
 #include "Camera.h"
 #include "Raytracer.h"
+#include "PerfCounter.h"
+#include "BatchRenderer.h"
+#include "ToneMap.h"
+#include "StreamingWriter.h"
+#include "SceneFile.h"
 #include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 
-int main() {
+/* Prints frame time and the tile/thread tail latencies of a render */
+static void printRenderStats(const RenderStats& stats) {
+	const TileTimeHistogram& tiles = stats.tileTimes;
+
+	double lastFinish = 0.0, idle = 0.0;
+	for (double finish : stats.threadFinishTimes) lastFinish = std::max(lastFinish, finish);
+	for (double finish : stats.threadFinishTimes) idle += lastFinish - finish;
+	if (!stats.threadFinishTimes.empty()) idle /= stats.threadFinishTimes.size();
+
+	std::cout << "Tiles: " << tiles.count
+			  << "  p50 " << tiles.percentile(0.5) * 1e3 << "ms"
+			  << "  p99 " << tiles.percentile(0.99) * 1e3 << "ms"
+			  << "  max " << tiles.max * 1e3 << "ms" << std::endl;
+	std::cout << "Mean end-of-frame idle per thread: " << idle * 1e3 << "ms" << std::endl;
+	std::cout << "Heap allocations while tracing: " << stats.allocations << std::endl;
+	if (stats.textureHits + stats.textureMisses > 0) {
+		std::cout << "Texture cache: " << stats.textureHits << " hits, " << stats.textureMisses << " misses ("
+				  << 100.0 * stats.textureHits / (stats.textureHits + stats.textureMisses) << "% hit rate)" << std::endl;
+	}
+}
+
+/* Per-job and aggregate throughput of a batch run */
+static void printBatchReport(const std::vector<BatchJobReport>& reports, const AssetCache& cache, double totalTime) {
+	long long totalPixels = 0;
+	int succeeded = 0;
+	for (const BatchJobReport& report : reports) {
+		if (!report.succeeded) {
+			std::cout << report.job.scenePath << ": FAILED (" << report.error << ")" << std::endl;
+			continue;
+		}
+		double jobTime = report.loadTime + report.renderTime + report.writeTime;
+		std::cout << report.job.scenePath << " -> " << report.job.outputPath
+				  << ": load " << report.loadTime << "s, render " << report.renderTime << "s, write " << report.writeTime
+				  << "s, " << report.pixels / jobTime * 1e-6 << " Mpixel/s" << std::endl;
+		totalPixels += report.pixels;
+		++succeeded;
+	}
+	std::cout << "Batch: " << succeeded << "/" << reports.size() << " jobs in " << totalTime << "s, "
+			  << succeeded / totalTime << " jobs/s, " << totalPixels / totalTime * 1e-6 << " Mpixel/s" << std::endl;
+	std::cout << "Texture cache: " << cache.getTextureLoads() << " loads, " << cache.getTextureHits() << " hits; "
+			  << "geometry cache: " << cache.getGeometryBuilds() << " builds, " << cache.getGeometryHits() << " hits" << std::endl;
+}
+
+/* Paging activity of a TextureCache */
+static void printTextureTiles(TextureCache& textureCache) {
+	std::cout << "Texture tiles: " << textureCache.getTileLoads() << " loaded, " << textureCache.getEvictions()
+			  << " evicted, " << textureCache.getResidentBytes() / 1024 << " of " << textureCache.getBudgetBytes() / 1024
+			  << " KB resident" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	PerfCounter llcMisses;	// before any thread exists, so it counts them all
 	double time;
 	//try {
 		/*std::cout << "Starting image tests...\n\n";
@@ -34,15 +93,376 @@ int main() {
 		image.writePPM("testingBinary.ppm");*/
 
 
+		// Usage: raytracer [scene.json] [output.ppm] [--schedule omp|steal] [--tile N]
+		//                  [--tile-order rowmajor|morton|hilbert] [--compare-tile-orders]
+		//                  [--progressive SECONDS] [--samples N] [--seed N]
+		//                  [--integrator recursive|iterative] [--assert-no-alloc]
+		//                  [--framebuffer rgb32f|rgb16f|rgbe] [--mmap-framebuffer] [--texture-filter nearest|trilinear]
+		//                  [--texture-layout rowmajor|tiled|bc1] [--compare-texture-layouts]
+		//                  [--texture-budget MB] [--texture-cache-dir DIR] [--stream-json]
+		//                  [--transfer linear|gamma|srgb] [--gamma G] [--dither] [--hdr radiance.pfm] [--stream]
+		//                  [--numa none|pin|firsttouch|replicate] [--compare-numa]
+		//        raytracer --batch manifest.json [options]
+		//        raytracer --tonemap radiance.pfm output.ppm|png [--exposure E] [--transfer ...] [--dither]
+		//                  (without --exposure, the one --hdr recorded in radiance.pfm.exposure)
+		//        raytracer --compress-texture texture.ppm texture.rtc [--texture-colorspace linear|srgb]
+		//        raytracer --compile-scene scene.json scene.rts
+		// Scenes ending in .rts are loaded as compiled scenes
+		std::string scenePath = "jsons/scenePhong.json";
+		std::string outputPath = "results/blinnPhong.ppm";
+		std::string schedule = "omp";
+		int tileSize = 16;
+		std::string tileOrder = "rowmajor";
+		bool compareTileOrders = false;
+		std::string numaMode = "none";
+		bool compareNuma = false;
+		std::string manifestPath;
+		std::string integrator = "recursive";
+		bool assertNoAlloc = false;
+		std::string framebuffer = "rgb32f";
+		bool mmapFramebuffer = false;
+		bool stream = false;
+		std::string textureFilter = "trilinear";
+		std::string textureLayout = "tiled";
+		bool compareTextureLayouts = false;
+		double textureBudget = 0.0;	// MB; > 0 pages textures through a TextureCache
+		std::string textureCacheDirectory;
+		bool streamJSON = false;
+		std::string hdrPath;
+		std::string toneMapInput;
+		std::string toneMapOutput;
+		std::string compressInput;
+		std::string compressOutput;
+		std::string textureColorSpace = "linear";	// of the texture --compress-texture converts
+		std::string compileInput;
+		std::string compileOutput;
+		float exposure = 1.0f;
+		bool exposureGiven = false;
+		OutputEncoding encoding;
+		bool progressive = false;
+		ProgressiveSettings progressiveSettings;
+		int positional = 0;
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--schedule" && i + 1 < argc) {
+				schedule = argv[++i];
+			} else if (arg == "--tile" && i + 1 < argc) {
+				tileSize = std::stoi(argv[++i]);
+			} else if (arg == "--tile-order" && i + 1 < argc) {
+				tileOrder = argv[++i];
+			} else if (arg == "--compare-tile-orders") {
+				compareTileOrders = true;
+			} else if (arg == "--integrator" && i + 1 < argc) {
+				integrator = argv[++i];
+			} else if (arg == "--framebuffer" && i + 1 < argc) {
+				framebuffer = argv[++i];
+			} else if (arg == "--transfer" && i + 1 < argc) {
+				encoding.transfer = parseTransferFunction(argv[++i]);
+			} else if (arg == "--gamma" && i + 1 < argc) {
+				encoding.transfer = TransferFunction::Gamma;
+				encoding.gamma = std::stof(argv[++i]);
+			} else if (arg == "--dither") {
+				encoding.dither = true;
+			} else if (arg == "--hdr" && i + 1 < argc) {
+				hdrPath = argv[++i];
+			} else if (arg == "--tonemap" && i + 2 < argc) {
+				toneMapInput = argv[++i];
+				toneMapOutput = argv[++i];
+			} else if (arg == "--compress-texture" && i + 2 < argc) {
+				compressInput = argv[++i];
+				compressOutput = argv[++i];
+			} else if (arg == "--texture-colorspace" && i + 1 < argc) {
+				textureColorSpace = argv[++i];
+			} else if (arg == "--compile-scene" && i + 2 < argc) {
+				compileInput = argv[++i];
+				compileOutput = argv[++i];
+			} else if (arg == "--exposure" && i + 1 < argc) {
+				exposure = std::stof(argv[++i]);
+				exposureGiven = true;
+			} else if (arg == "--texture-filter" && i + 1 < argc) {
+				textureFilter = argv[++i];
+			} else if (arg == "--texture-layout" && i + 1 < argc) {
+				textureLayout = argv[++i];
+			} else if (arg == "--compare-texture-layouts") {
+				compareTextureLayouts = true;
+			} else if (arg == "--texture-budget" && i + 1 < argc) {
+				textureBudget = std::stod(argv[++i]);
+			} else if (arg == "--texture-cache-dir" && i + 1 < argc) {
+				textureCacheDirectory = argv[++i];
+			} else if (arg == "--stream-json") {
+				streamJSON = true;
+			} else if (arg == "--stream") {
+				stream = true;
+			} else if (arg == "--mmap-framebuffer") {
+				mmapFramebuffer = true;
+			} else if (arg == "--assert-no-alloc") {
+				assertNoAlloc = true;
+			} else if (arg == "--numa" && i + 1 < argc) {
+				numaMode = argv[++i];
+			} else if (arg == "--compare-numa") {
+				compareNuma = true;
+			} else if (arg == "--batch" && i + 1 < argc) {
+				manifestPath = argv[++i];
+			} else if (arg == "--progressive" && i + 1 < argc) {
+				progressive = true;
+				progressiveSettings.timeBudget = std::stod(argv[++i]);
+			} else if (arg == "--samples" && i + 1 < argc) {
+				progressiveSettings.maxSamples = std::stoi(argv[++i]);
+			} else if (arg == "--seed" && i + 1 < argc) {
+				progressiveSettings.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+			} else if (positional++ == 0) {
+				scenePath = arg;
+			} else {
+				outputPath = arg;
+			}
+		}
+
+		if (!toneMapInput.empty()) {
+			// Re-expose a saved radiance buffer: no scene, no rays
+			Image radiance;
+			if (!radiance.loadPFM(toneMapInput)) {
+				std::cerr << "Could not read PFM file: " << toneMapInput << std::endl;
+				return 1;
+			}
+			if (!exposureGiven && !readExposure(toneMapInput, exposure)) {
+				std::cerr << "No exposure recorded for " << toneMapInput << ", pass --exposure E" << std::endl;
+				return 1;
+			}
+			time = omp_get_wtime();
+			Image output(radiance.getWidth(), radiance.getHeight(), false);
+			toneMapImage(radiance, output, exposure);
+			std::cout << "Tonemap: " << (omp_get_wtime() - time) * 1e3 << "ms (exposure " << exposure << ")" << std::endl;
+			time = omp_get_wtime();
+			if (!output.write(toneMapOutput, encoding)) {
+				std::cerr << "Could not write " << toneMapOutput << std::endl;
+				return 1;
+			}
+			std::cout << "Write: " << (omp_get_wtime() - time) * 1e3 << "ms" << std::endl;
+			return 0;
+		}
+
+		if (!compressInput.empty()) {
+			// Offline BC1 conversion; scenes can then name the .rtc file as their texture.
+			// The file records the color space, so it decodes the same whatever the scene says
+			ColorSpace colorSpace = parseColorSpace(textureColorSpace);
+			time = omp_get_wtime();
+			Texture compressed(compressInput, colorSpace, TextureLayout::BC1);
+			std::cout << "Compress: " << (omp_get_wtime() - time) * 1e3 << "ms" << std::endl;
+			if (!compressed.writeCompressed(compressOutput)) {
+				std::cerr << "Could not write " << compressOutput << std::endl;
+				return 1;
+			}
+			Texture original(compressInput, colorSpace, TextureLayout::RowMajor);
+			double squaredError = 0.0;
+			for (int y = 0; y < original.getHeight(); ++y) {
+				for (int x = 0; x < original.getWidth(); ++x) {
+					Color difference = (original.getTexel(x, y) - compressed.getTexel(x, y)) * 255.0f;
+					squaredError += difference.getR() * difference.getR() + difference.getG() * difference.getG() +
+									difference.getB() * difference.getB();
+				}
+			}
+			double meanError = squaredError / (3.0 * original.getWidth() * original.getHeight());
+			std::cout << original.getByteSize() << " -> " << compressed.getByteSize() << " bytes, PSNR "
+					  << (meanError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanError) : INFINITY) << " dB" << std::endl;
+			return 0;
+		}
+
+		if (!compileInput.empty()) {
+			time = omp_get_wtime();
+			SceneFile::compile(compileInput, compileOutput);
+			std::cout << "Compile: " << omp_get_wtime() - time << "s" << std::endl;
+			// Both loads to a ready-to-render scene, side by side
+			time = omp_get_wtime();
+			Raytracer jsonRaytracer;
+			jsonRaytracer.loadJSON(compileInput);
+			double jsonTime = omp_get_wtime() - time;
+			time = omp_get_wtime();
+			Raytracer compiledRaytracer;
+			compiledRaytracer.loadCompiled(compileOutput);
+			double compiledTime = omp_get_wtime() - time;
+			std::cout << "Load: JSON " << jsonTime << "s, compiled " << compiledTime << "s ("
+					  << jsonTime / compiledTime << "x)" << std::endl;
+			return 0;
+		}
+
+		std::shared_ptr<TaskScheduler> scheduler = nullptr;
+		if (schedule == "steal") {
+			NumaTopology topology;
+			bool pin = parseNumaMode(numaMode) != NumaMode::None;
+			scheduler = std::make_shared<TaskScheduler>(0, [topology, pin](int worker) {
+				if (pin) topology.pinCurrentThread(worker);
+			});
+		}
+
+		std::shared_ptr<TextureCache> textureCache = nullptr;
+		if (textureBudget > 0.0) {
+			// Textures stay on disk as tile files; only the tiles the render touches are read, within the budget.
+			// One cache for a whole batch, so every job shares the budget
+			textureCache = TextureCache::create(static_cast<size_t>(textureBudget * 1024 * 1024), textureCacheDirectory);
+		}
+
+		if (!manifestPath.empty()) {
+			// One process for the whole manifest: shared threads, textures and geometry
+			BatchRenderer batch(scheduler, [&](Raytracer& jobRaytracer) {
+				jobRaytracer.setTileSize(tileSize);
+				jobRaytracer.setTileOrder(parseTileOrder(tileOrder));
+				jobRaytracer.setIntegrator(integrator == "iterative" ? Integrator::Iterative : Integrator::Recursive);
+				jobRaytracer.setFramebufferFormat(parsePixelFormat(framebuffer));
+				jobRaytracer.setTextureFilter(parseTextureFilter(textureFilter));
+				jobRaytracer.setNumaMode(parseNumaMode(numaMode));
+			}, [&](Raytracer& jobRaytracer) {
+				jobRaytracer.setTextureLayout(parseTextureLayout(textureLayout));
+				jobRaytracer.setJSONStreaming(streamJSON);
+				jobRaytracer.setTextureCache(textureCache);
+			});
+			batch.setEncoding(encoding);
+			time = omp_get_wtime();
+			std::vector<BatchJobReport> reports = batch.run(BatchRenderer::readManifest(manifestPath));
+			printBatchReport(reports, batch.getCache(), omp_get_wtime() - time);
+			if (textureCache) printTextureTiles(*textureCache);
+			return 0;
+		}
+
 		Raytracer raytracer = Raytracer();
-		Image image = raytracer.readJSON("jsons/scenePhong.json");
+		raytracer.setTextureLayout(parseTextureLayout(textureLayout));
+		raytracer.setJSONStreaming(streamJSON);
+		raytracer.setTextureCache(textureCache);
+		double loadStart = omp_get_wtime();
+		raytracer.loadScene(scenePath);
+		double loadTime = omp_get_wtime() - loadStart;
+		if (const ShapePool* pool = raytracer.getShapePool()) {
+			std::cout << "Scene: " << pool->getNumShapes() << " shapes in a " << pool->getBytes() << " byte pool, loaded in "
+					  << loadTime << "s"
+					  << (pool->usesHugePages() ? " (huge pages)" : "") << ", resident "
+					  << residentSetBytes() / (1024.0 * 1024.0) << " MB after loading" << std::endl;
+		}
+		raytracer.setTileSize(tileSize);
+		raytracer.setTileOrder(parseTileOrder(tileOrder));
+		raytracer.setTaskScheduler(scheduler);
+		raytracer.setIntegrator(integrator == "iterative" ? Integrator::Iterative : Integrator::Recursive);
+		raytracer.setFramebufferFormat(parsePixelFormat(framebuffer));
+		raytracer.setTextureFilter(parseTextureFilter(textureFilter));
+
+		if (compareTextureLayouts) {
+			// Same frame once per texel layout; the scene is reloaded so its textures are packed that way
+			for (TextureLayout layout : {TextureLayout::RowMajor, TextureLayout::Tiled, TextureLayout::BC1}) {
+				Raytracer layoutRaytracer;
+				layoutRaytracer.setTextureLayout(layout);
+				layoutRaytracer.loadScene(scenePath);
+				layoutRaytracer.setTileSize(tileSize);
+				layoutRaytracer.setTileOrder(parseTileOrder(tileOrder));
+				layoutRaytracer.setTaskScheduler(scheduler);
+				layoutRaytracer.setIntegrator(integrator == "iterative" ? Integrator::Iterative : Integrator::Recursive);
+				layoutRaytracer.setTextureFilter(parseTextureFilter(textureFilter));
+				Image layoutImage = layoutRaytracer.createImage();
+				layoutRaytracer.render(layoutImage);	// warm-up: page in the textures
+				llcMisses.start();
+				RenderStats layoutStats = layoutRaytracer.render(layoutImage);
+				long long misses = llcMisses.stop();
+				std::cout << textureLayoutName(layout) << " textures: " << layoutStats.totalTime << "s, LLC misses: ";
+				if (misses >= 0) std::cout << misses << std::endl;
+				else std::cout << "n/a" << std::endl;
+			}
+		}
+
+		if (compareNuma) {
+			// Allocation + first touch + render, once per placement mode
+			for (NumaMode mode : {NumaMode::None, NumaMode::Pin, NumaMode::FirstTouch, NumaMode::Replicate}) {
+				raytracer.setNumaMode(mode);
+				double modeStart = omp_get_wtime();
+				Image modeImage = raytracer.createImage();
+				double allocated = omp_get_wtime();
+				raytracer.render(modeImage);
+				std::cout << numaModeName(mode) << ": allocate " << allocated - modeStart << "s, render "
+						  << omp_get_wtime() - allocated << "s" << std::endl;
+			}
+		}
+		raytracer.setNumaMode(parseNumaMode(numaMode));
+		// A mapped framebuffer is the output file itself, written back band by band while rendering
+		if (mmapFramebuffer && std::filesystem::path(outputPath).extension() != ".ppm") {
+			std::cerr << "--mmap-framebuffer renders straight into a .ppm output file" << std::endl;
+			return 1;
+		}
+		Image image = mmapFramebuffer ? raytracer.createMappedImage(outputPath) : raytracer.createImage();
+		if (image.isMapped() || image.getFormat() != PixelFormat::RGB32F) {
+			std::cout << "Framebuffer: " << pixelFormatName(image.getFormat()) << ", " << image.getByteSize() << " bytes"
+					  << (image.isMapped() ? " mapped from " + outputPath : "") << std::endl;
+		}
+
+		if (compareTileOrders) {
+			// Same frame once per traversal order: time and last-level-cache misses side by side
+			for (TileOrder order : {TileOrder::RowMajor, TileOrder::Morton, TileOrder::Hilbert}) {
+				raytracer.setTileOrder(order);
+				llcMisses.start();
+				RenderStats orderStats = raytracer.render(image);
+				long long misses = llcMisses.stop();
+				std::cout << tileOrderName(order) << ": " << orderStats.totalTime << "s, LLC misses: ";
+				if (misses >= 0) std::cout << misses << std::endl;
+				else std::cout << "n/a" << std::endl;
+			}
+			raytracer.setTileOrder(parseTileOrder(tileOrder));
+		}
+
+		if (progressive) {
+			time = omp_get_wtime();
+			int samples = raytracer.renderProgressive(image, progressiveSettings, [time](const Image&, int pass, int samplesPerPixel) {
+				std::cout << "Pass " << pass << ": " << samplesPerPixel << " spp at " << omp_get_wtime() - time << "s" << std::endl;
+			});
+			std::cout << "Progressive: " << samples << " spp in " << omp_get_wtime() - time << "s" << std::endl;
+			image.write(outputPath, encoding);
+			return 0;
+		}
+
+		if (assertNoAlloc) {
+			raytracer.render(image);	// warm-up frame: thread pools, arenas and queues reach their working size
+		}
+
+		// Unclamped radiance next to the tone mapped frame, written as PFM for --tonemap
+		std::unique_ptr<Image> radiance;
+		if (!hdrPath.empty()) radiance = std::make_unique<Image>(image.getWidth(), image.getHeight(), false);
+
+		// Streamed outputs are written band by band on a background thread while the frame renders
+		std::unique_ptr<StreamingWriter> imageStream, radianceStream;
+		RowsCallback onRowsFinished = nullptr;
+		if (stream) {
+			if (!image.isMapped()) imageStream = std::make_unique<StreamingWriter>(image, outputPath, encoding);
+			if (radiance) radianceStream = std::make_unique<StreamingWriter>(*radiance, hdrPath);
+			onRowsFinished = [&imageStream, &radianceStream](int y0, int y1) {
+				if (imageStream) imageStream->rowsFinished(y0, y1);
+				if (radianceStream) radianceStream->rowsFinished(y0, y1);
+			};
+		}
 
 		time = omp_get_wtime();
-		raytracer.render(image);
+		llcMisses.start();
+		RenderStats stats = raytracer.render(image, radiance.get(), onRowsFinished);
+		long long misses = llcMisses.stop();
 
 		time = omp_get_wtime() - time;
-		std::cout << "Time: " << time << "s" << std::endl;
-		image.writePPM("results/blinnPhong.ppm");
+		std::cout << "Time: " << time << "s (" << omp_get_max_threads() << " threads, " << schedule << ", " << tileOrder << ")" << std::endl;
+		if (misses >= 0) std::cout << "LLC misses: " << misses << std::endl;
+		printRenderStats(stats);
+		if (textureCache) printTextureTiles(*textureCache);
+		time = omp_get_wtime();
+		bool written = imageStream ? imageStream->finish() : image.write(outputPath, encoding);
+		if (radiance) {
+			bool radianceWritten = radianceStream ? radianceStream->finish() : radiance->writePFM(hdrPath);
+			if (!radianceWritten || !writeExposure(hdrPath, raytracer.getExposure())) {
+				std::cerr << "Could not write " << hdrPath << std::endl;
+				return 1;
+			}
+		}
+		// streamed: only the tail left after the last band
+		std::cout << "Write: " << (omp_get_wtime() - time) * 1e3 << "ms"
+				  << (imageStream ? " after streaming " + std::to_string(imageStream->getBandsWritten()) + " bands" : "") << std::endl;
+		if (!written) {
+			std::cerr << "Could not write " << outputPath << std::endl;
+			return 1;
+		}
+		if (assertNoAlloc && stats.allocations != 0) {
+			std::cerr << "Steady-state render allocated " << stats.allocations << " times" << std::endl;
+			return 1;
+		}
 		return 0;
 
 }
\ No newline at end of file